@@ -37,22 +37,22 @@
 #include <fstream>
 #include <string>
 #include <ctime>
+#include <stdint.h>
 #include "aabbcolor.h"
+#include "broadphase.h"
+#include "coloring.h"
 
 using namespace std;
 
-// A private method to remove all of a given node from the neighbors list.
-
-void GraphNode::vectorRemove(GraphNode *node) {
-	this->neighbors.erase(remove(this->neighbors.begin(),this->neighbors.end(),node),this->neighbors.end());
-}
-
 // A node is always created with an index, no color (-1 is a special value), and no neighbors.
+// The position is where it lives in its graph's node list, which is how the edges refer to it.
 
-GraphNode::GraphNode(int index) {
+GraphNode::GraphNode(Graph *graph, int position, int index) {
+	this->graph = graph;
+	this->position = position;
 	this->index = index;
 	this->color = -1;
-	this->neighbors.clear(); // Technically unnecessary, but put here just as a reminder.
+	this->alive = true;
 }
 
 // Returns the index of this node.
@@ -64,6 +64,10 @@ int GraphNode::getIndex() {
 // Sets the index of this node. (Should be unnecessary for this application, but who knows.)
 
 void GraphNode::setIndex(int index) {
+	if (this->alive) {
+		this->graph->positions.erase(this->index);
+		this->graph->positions[index] = this->position;
+	}
 	this->index = index;
 }
 
@@ -84,10 +88,8 @@ void GraphNode::setColor(int color) {
 // this node as a neighbor to the other node. Returns the new degree.
 
 int GraphNode::addNeighbor(GraphNode *neighbor) {
-	if (!this->isNeighbor(neighbor))
-		this->neighbors.push_back(neighbor);
-	if (!neighbor->isNeighbor(this))
-		neighbor->neighbors.push_back(this);
+	this->graph->link(this->position, neighbor->position);
+	this->graph->compactIfNeeded();
 	return this->getDegree();
 }
 
@@ -95,21 +97,21 @@ int GraphNode::addNeighbor(GraphNode *neighbor) {
 // degree (which can be checked before/after to see if the operation succeeded).
 
 int GraphNode::removeNeighbor(GraphNode *neighbor) {
-	this->vectorRemove(neighbor);
-	neighbor->vectorRemove(this);
+	this->graph->unlink(this->position, neighbor->position);
+	this->graph->compactIfNeeded();
 	return this->getDegree();
 }
 
 // Returns whether the given vertex is a neighbor of this vertex.
 
 bool GraphNode::isNeighbor(GraphNode *neighbor) {
-	return (find(this->neighbors.begin(),this->neighbors.end(),neighbor) != this->neighbors.end());
+	return binary_search(this->graph->neighborsBegin(this->position), this->graph->neighborsEnd(this->position), neighbor->position);
 }
 
 // Returns the degree (number of neighbors) of this vertex.
 
 int GraphNode::getDegree() {
-	return (int)this->neighbors.size();
+	return (int)(this->graph->neighborsEnd(this->position) - this->graph->neighborsBegin(this->position));
 }
 
 // Returns the saturation of this vertex. This is the total number of unique colors used by the
@@ -117,13 +119,11 @@ int GraphNode::getDegree() {
 
 int GraphNode::getSaturation() {
 	set<int> uniqueColors;
-	vector<GraphNode*>::iterator it;
-	for (it = this->neighbors.begin(); it != this->neighbors.end(); it++) {
-		int color = (*it)->getColor();
+	const int *end = this->graph->neighborsEnd(this->position);
+	for (const int *it = this->graph->neighborsBegin(this->position); it != end; it++) {
+		int color = this->graph->nodes[*it].getColor();
 		if (color < 0)
 			continue;
-		if (uniqueColors.find(color) != uniqueColors.end())
-			continue;
 		uniqueColors.insert(color);
 	}
 	return (int)uniqueColors.size();
@@ -132,9 +132,9 @@ int GraphNode::getSaturation() {
 // Returns whether a color is valid for this vertex (none of its neighbors have it).
 
 bool GraphNode::isValidColor(int color) {
-	vector<GraphNode*>::iterator it;
-	for (it = this->neighbors.begin(); it != this->neighbors.end(); it++) {
-		int neighborColor = (*it)->getColor();
+	const int *end = this->graph->neighborsEnd(this->position);
+	for (const int *it = this->graph->neighborsBegin(this->position); it != end; it++) {
+		int neighborColor = this->graph->nodes[*it].getColor();
 		if (neighborColor < 0)
 			continue;
 		if (neighborColor == color)
@@ -143,41 +143,235 @@ bool GraphNode::isValidColor(int color) {
 	return true;
 }
 
+// Big enough that a big map's nodes only take a few dozen blocks, small enough not to matter for a
+// small graph.
+#define GRAPH_ARENA_BLOCK_SIZE (256 << 10)
+
 // Creates a graph with no vertices.
 
-Graph::Graph() {
-	this->nodes.clear(); // Again, just for readability.
+Graph::Graph() : arena(new Arena(GRAPH_ARENA_BLOCK_SIZE)), nodes(ArenaAllocator<GraphNode>(arena.get())), positions(0, hash<int>(), equal_to<int>(), ArenaAllocator<pair<const int, int> >(arena.get())) {
+	this->liveCount = 0;
+	this->edgeCount = 0;
+	this->colored = false;
+}
+
+// Creates a graph with the vertices 0 .. size - 1 and the given edges between them, all at once.
+
+Graph::Graph(int size, const vector<pair<int, int> > &edges) : Graph() {
+	this->adjacency = CSRGraph(size, edges);
+	this->positions.reserve(size);
+	for (int i = 0; i < size; i++) {
+		this->nodes.push_back(GraphNode(this, i, i));
+		this->positions[i] = i;
+	}
+	this->liveCount = size;
+	this->edgeCount = this->adjacency.getEdgeCount();
+	this->boxes.assign(size, AABB(0, 0, 0, 0, 0, 0));
+	this->hasBox.assign(size, false);
+	this->colored = false;
+}
+
+// The same, but vertex i is the AABB boxes[i]. This is how getCollisions builds its graph, and
+// it's what lets brushes be edited afterwards.
+
+Graph::Graph(vector<AABB> boxes, const vector<pair<int, int> > &edges) : Graph((int)boxes.size(), edges) {
+	this->boxes.swap(boxes);
+	this->hasBox.assign(this->boxes.size(), true);
+}
+
+// Copying or moving a graph has to point the copied nodes at their new graph. A copy gets an arena
+// of its own; a move takes the arena along and leaves the old graph a fresh, empty one.
+
+Graph::Graph(const Graph &other) : arena(new Arena(GRAPH_ARENA_BLOCK_SIZE)), nodes(other.nodes.begin(), other.nodes.end(), ArenaAllocator<GraphNode>(arena.get())), positions(other.positions.begin(), other.positions.end(), other.positions.bucket_count(), hash<int>(), equal_to<int>(), ArenaAllocator<pair<const int, int> >(arena.get())), liveCount(other.liveCount), adjacency(other.adjacency), changedNeighbors(other.changedNeighbors), edgeCount(other.edgeCount), boxes(other.boxes), hasBox(other.hasBox), colored(other.colored) {
+	this->attachNodes();
+}
+
+Graph::Graph(Graph &&other) : arena(std::move(other.arena)), nodes(std::move(other.nodes)), positions(std::move(other.positions)), liveCount(other.liveCount), adjacency(std::move(other.adjacency)), changedNeighbors(std::move(other.changedNeighbors)), edgeCount(other.edgeCount), boxes(std::move(other.boxes)), hasBox(std::move(other.hasBox)), colored(other.colored) {
+	this->attachNodes();
+	other.resetArena();
+}
+
+Graph &Graph::operator=(const Graph &other) {
+	if (this != &other) {
+		this->nodes = other.nodes;
+		this->positions = other.positions;
+		this->liveCount = other.liveCount;
+		this->adjacency = other.adjacency;
+		this->changedNeighbors = other.changedNeighbors;
+		this->edgeCount = other.edgeCount;
+		this->boxes = other.boxes;
+		this->hasBox = other.hasBox;
+		this->colored = other.colored;
+		this->attachNodes();
+	}
+	return *this;
+}
+
+Graph &Graph::operator=(Graph &&other) {
+	if (this != &other) {
+		// Swapping trades the arenas along with everything in them.
+		this->arena.swap(other.arena);
+		this->nodes.swap(other.nodes);
+		this->positions.swap(other.positions);
+		this->liveCount = other.liveCount;
+		this->adjacency = std::move(other.adjacency);
+		this->changedNeighbors = std::move(other.changedNeighbors);
+		this->edgeCount = other.edgeCount;
+		this->boxes = std::move(other.boxes);
+		this->hasBox = std::move(other.hasBox);
+		this->colored = other.colored;
+		this->attachNodes();
+	}
+	return *this;
+}
+
+void Graph::attachNodes() {
+	NodeList::iterator it;
+	for (it = this->nodes.begin(); it != this->nodes.end(); it++)
+		it->graph = this;
+}
+
+// Leaves a graph that has been moved from empty, with an arena of its own again, so nothing it
+// does later touches the arena it gave away.
+
+void Graph::resetArena() {
+	this->arena.reset(new Arena(GRAPH_ARENA_BLOCK_SIZE));
+	this->nodes = NodeList(ArenaAllocator<GraphNode>(this->arena.get()));
+	this->positions = PositionMap(0, hash<int>(), equal_to<int>(), ArenaAllocator<pair<const int, int> >(this->arena.get()));
+	this->liveCount = 0;
+	this->adjacency = CSRGraph();
+	this->changedNeighbors.clear();
+	this->edgeCount = 0;
+	this->boxes.clear();
+	this->hasBox.clear();
+	this->colored = false;
+}
+
+// Returns the sorted neighbor positions of the node at a position: its edited copy if it has one,
+// otherwise its row of the CSRGraph. Nodes added since the CSRGraph was built have no row yet.
+
+const int *Graph::neighborsBegin(int position) {
+	unordered_map<int, vector<int> >::iterator it = this->changedNeighbors.find(position);
+	if (it != this->changedNeighbors.end())
+		return it->second.data();
+	if (position >= this->adjacency.getNodeCount())
+		return NULL;
+	return this->adjacency.neighborsBegin(position);
+}
+
+const int *Graph::neighborsEnd(int position) {
+	unordered_map<int, vector<int> >::iterator it = this->changedNeighbors.find(position);
+	if (it != this->changedNeighbors.end())
+		return it->second.data() + it->second.size();
+	if (position >= this->adjacency.getNodeCount())
+		return NULL;
+	return this->adjacency.neighborsEnd(position);
+}
+
+// Returns a neighbor list that can be changed, copying it out of the CSRGraph the first time.
+
+vector<int> &Graph::editNeighbors(int position) {
+	unordered_map<int, vector<int> >::iterator it = this->changedNeighbors.find(position);
+	if (it != this->changedNeighbors.end())
+		return it->second;
+	vector<int> &neighbors = this->changedNeighbors[position];
+	if (position < this->adjacency.getNodeCount())
+		neighbors.assign(this->adjacency.neighborsBegin(position), this->adjacency.neighborsEnd(position));
+	return neighbors;
+}
+
+// Adds or removes the edge between two positions, keeping both lists sorted. Returns whether
+// anything changed. Loops are never added, the same as the CSRGraph.
+
+bool Graph::link(int position1, int position2) {
+	if (position1 == position2)
+		return false;
+	vector<int> &neighbors1 = this->editNeighbors(position1);
+	vector<int>::iterator it = lower_bound(neighbors1.begin(), neighbors1.end(), position2);
+	if (it != neighbors1.end() && *it == position2)
+		return false;
+	neighbors1.insert(it, position2);
+	vector<int> &neighbors2 = this->editNeighbors(position2);
+	neighbors2.insert(lower_bound(neighbors2.begin(), neighbors2.end(), position1), position1);
+	this->edgeCount++;
+	return true;
+}
+
+bool Graph::unlink(int position1, int position2) {
+	if (position1 == position2 || !binary_search(this->neighborsBegin(position1), this->neighborsEnd(position1), position2))
+		return false;
+	vector<int> &neighbors1 = this->editNeighbors(position1);
+	neighbors1.erase(lower_bound(neighbors1.begin(), neighbors1.end(), position2));
+	vector<int> &neighbors2 = this->editNeighbors(position2);
+	neighbors2.erase(lower_bound(neighbors2.begin(), neighbors2.end(), position1));
+	this->edgeCount--;
+	return true;
+}
+
+// Removes every edge a node has.
+
+void Graph::unlinkAll(int position) {
+	vector<int> neighbors(this->neighborsBegin(position), this->neighborsEnd(position));
+	for (size_t i = 0; i < neighbors.size(); i++)
+		this->unlink(position, neighbors[i]);
+}
+
+// Folds the edited neighbor lists back into a fresh CSRGraph.
+
+void Graph::compact() {
+	if (this->changedNeighbors.empty() && this->adjacency.getNodeCount() == (int)this->nodes.size())
+		return;
+	vector<pair<int, int> > edges;
+	edges.reserve(this->edgeCount);
+	for (int i = 0; i < (int)this->nodes.size(); i++) {
+		const int *end = this->neighborsEnd(i);
+		for (const int *it = this->neighborsBegin(i); it != end && *it < i; it++)
+			edges.push_back(make_pair(i, *it));
+	}
+	this->adjacency = CSRGraph((int)this->nodes.size(), edges);
+	this->changedNeighbors.clear();
+}
+
+// Edited lists are slower to get at and take more memory than CSR rows, so once a quarter of the
+// nodes have one it's worth rebuilding.
+
+void Graph::compactIfNeeded() {
+	if (this->changedNeighbors.size() > this->nodes.size() / 4 + 16)
+		this->compact();
 }
 
 // Adds a vertex to a graph. The vertex is created here. Returns the new size.
 
 int Graph::addNode(int index) {
 	if (!this->containsNode(index)) {
-		GraphNode newNode(index);
-		this->nodes.push_back(newNode);
+		int position = (int)this->nodes.size();
+		this->nodes.push_back(GraphNode(this, position, index));
+		this->positions[index] = position;
+		this->boxes.push_back(AABB(0, 0, 0, 0, 0, 0));
+		this->hasBox.push_back(false);
+		this->liveCount++;
 	}
 	return this->getSize();
 }
 
 // Removes a vertex from a graph, either by index or by pointer. Returns the new size.
+// The node is only marked as dead so that nothing else moves; its edges go away with it.
 
 int Graph::removeNode(int index) {
-	vector<GraphNode>::iterator it;
-	for (it = this->nodes.begin(); it != this->nodes.end(); it++) {
-		if (it->getIndex() == index)
-			it = this->nodes.erase(it);
-	}
+	GraphNode *node = this->findNode(index);
+	if (node != NULL)
+		this->removeNode(node);
 	return this->getSize();
 }
 
-// I feel like there's a really easy way to do this that I'm not realizing ...
-// Eh, whatever.
-
 int Graph::removeNode(GraphNode *node) {
-	vector<GraphNode>::iterator it;
-	for (it = this->nodes.begin(); it != this->nodes.end(); it++) {
-		if (&(*it) == node)
-			it = this->nodes.erase(it);
+	if (node->alive) {
+		this->unlinkAll(node->position);
+		this->compactIfNeeded();
+		node->alive = false;
+		node->color = -1;
+		this->positions.erase(node->index);
+		this->liveCount--;
 	}
 	return this->getSize();
 }
@@ -185,35 +379,40 @@ int Graph::removeNode(GraphNode *node) {
 // Returns whether the given node exists in the given graph.
 
 bool Graph::containsNode(int index) {
-	vector<GraphNode>::iterator it;
-	for (it = this->nodes.begin(); it != this->nodes.end(); it++) {
-		if (it->getIndex() == index)
-			return true;
-	}
-	return false;
+	return (this->positions.find(index) != this->positions.end());
 }
 
 // Returns a reference pointer to the node having the given index. Returns NULL if it doesn't exist.
 
 GraphNode *Graph::findNode(int index) {
-	vector<GraphNode>::iterator it;
-	for (it = this->nodes.begin(); it != this->nodes.end(); it++) {
-		if (it->getIndex() == index)
-			return &(*it); // Technically not always "safe," but should be in this context.
-	}
-	return NULL;
+	PositionMap::iterator it = this->positions.find(index);
+	if (it == this->positions.end())
+		return NULL;
+	return &this->nodes[it->second];
+}
+
+// Gets the AABB of the brush with the given index. Returns false if there's no such brush, or if it
+// was added without one.
+
+bool Graph::getBox(int index, AABB &box) {
+	PositionMap::iterator it = this->positions.find(index);
+	if (it == this->positions.end() || !this->hasBox[it->second])
+		return false;
+	box = this->boxes[it->second];
+	return true;
 }
 
 // Returns the size of a graph (number of nodes).
 
 int Graph::getSize() {
-	return (int)this->nodes.size();
+	return this->liveCount;
 }
 
 // Adds an edge between two vertices.
 
 void Graph::addEdge(int index1, int index2) {
-	this->findNode(index1)->addNeighbor(this->findNode(index2));
+	this->link(this->findNode(index1)->position, this->findNode(index2)->position);
+	this->compactIfNeeded();
 }
 
 // Removes an edge between two vertices.
@@ -225,103 +424,357 @@ void Graph::removeEdge(int index1, int index2) {
 // Returns whether there is an edge between two vertices.
 
 bool Graph::isEdge(int index1, int index2) {
-	cout << endl << "ptr " << this->findNode(index1) << " and " << this->findNode(index2) << " -> " << this->findNode(index1)->isNeighbor(this->findNode(index2));
 	return this->findNode(index1)->isNeighbor(this->findNode(index2));
 }
 
 // Returns the total number of edges in the graph.
 
 int Graph::getEdgeCount() {
-	int totalDegree = 0;
-	vector<GraphNode>::iterator it;
-	for (it = this->nodes.begin(); it != this->nodes.end(); it++)
-		totalDegree += it->getDegree();
-	return totalDegree/2;
+	return (int)this->edgeCount;
 }
 
-// Clears all vertex colors and attempts to find a minimal coloring using the DSATUR algorithm.
+// Returns the edges as a CSRGraph over node positions (the order nodes were added in). Removed
+// nodes keep their position but have no edges.
 
-void Graph::colorDSATUR() {
-	// Remove all vertex colors.
-	vector<GraphNode>::iterator it;
-	for (it = this->nodes.begin(); it != this->nodes.end(); it++)
-		it->setColor(-1);
-	// Next, we want to iterate until all nodes are colored.
-	while (true) { // We'll break, don't worry.
-		GraphNode *next = NULL; // This will be the vertex we operate on.
-		// We pick as follows: an uncolored node with the highest saturation.
-		// In the case of a tie, choose the node with the highest degree.
-		// If a tie still exists, we will choose the first such node in the vector.
-		for (it = this->nodes.begin(); it != this->nodes.end(); it++) {
-			if (it->getColor() != -1)
-				continue;
-			if (next == NULL) {
-				next = &(*it);
-				continue;
-			}
-			if (it->getSaturation() > next->getSaturation()) {
-				next = &(*it);
-				continue;
-			}
-			if (it->getSaturation() == next->getSaturation() && it->getDegree() > next->getDegree()) {
-				next = &(*it);
-				continue;
-			}
-		}
-		if (next == NULL) // There are no uncolored nodes left.
-			break; // See? I told you we would break;
-		// Now let's color this node!
-		int color = 0;
-		// Check if this color is valid. If not, increase it until it is.
-		while (!next->isValidColor(color))
-			color++;
-		// Color the node.
-		next->setColor(color);
-		// And repeat!
+const CSRGraph &Graph::getAdjacency() {
+	this->compact();
+	return this->adjacency;
+}
+
+// Links the node at a position to every other live brush its AABB touches. Testing them all is
+// only a few hundred microseconds even for a big map, which is far less than any index would
+// cost to keep up to date.
+
+void Graph::linkBox(int position) {
+	AABB &box = this->boxes[position];
+	for (int i = 0; i < (int)this->nodes.size(); i++) {
+		if (i != position && this->hasBox[i] && this->nodes[i].alive && box.intersects(&this->boxes[i]))
+			this->link(position, i);
 	}
 }
 
-// Gets the sets of indices. This is in the form of a null-terminated array of arrays of indices.
-// The index arrays are terminated with -1.
-// Each of the inner arrays contains vertices of the same color, and together, they partition
-// the graph.
-// Note that this should only be called once per coloring, as it allocates memory each time.
+// Returns how many colors the live nodes are using (one more than the highest).
 
-int **Graph::getColorSets() {
-	// Determine the size of the outer array.
-	int maxColor = 0;
-	vector<GraphNode>::iterator it;
+int Graph::getColorCount() {
+	int count = 0;
+	NodeList::iterator it;
 	for (it = this->nodes.begin(); it != this->nodes.end(); it++) {
-		int color = it->getColor();
+		if (it->alive && it->color >= count)
+			count = it->color + 1;
+	}
+	return count;
+}
+
+// Colors a node that has just changed without adding a color if it can be helped. First choice is
+// the smallest color none of its neighbors have. Failing that, a color only one neighbor has will
+// do if that neighbor can move to some other color. If neither works, a new color is needed, and
+// at that point the whole graph is recolored since it's likely DSATUR can do better anyway.
+// Returns the node's color.
+
+int Graph::repairColor(int position) {
+	GraphNode &node = this->nodes[position];
+	node.color = -1;
+	int colorCount = this->getColorCount();
+
+	// How many neighbors have each color, and the last one seen with it.
+	vector<int> users(colorCount, 0);
+	vector<int> user(colorCount, -1);
+	const int *end = this->neighborsEnd(position);
+	for (const int *it = this->neighborsBegin(position); it != end; it++) {
+		int color = this->nodes[*it].color;
 		if (color < 0)
-			return NULL; // The graph must be fully colored first!
-		if (color > maxColor)
-			maxColor = color;
+			continue;
+		users[color]++;
+		user[color] = *it;
+	}
+	for (int color = 0; color < colorCount; color++) {
+		if (users[color] == 0) {
+			node.color = color;
+			return color;
+		}
 	}
-	int **colorSets = new int*[maxColor+2];
-	colorSets[maxColor+1] = NULL;
-	for (int currentColor = 0; currentColor <= maxColor; currentColor++) {
-		// Determine the number of vertices in this set.
-		int setSize = 0;
-		for (it = this->nodes.begin(); it != this->nodes.end(); it++) {
-			int color = it->getColor();
-			if (color == currentColor)
-				setSize++;
+	for (int color = 0; color < colorCount; color++) {
+		if (users[color] != 1)
+			continue;
+		GraphNode &neighbor = this->nodes[user[color]];
+		for (int other = 0; other < colorCount; other++) {
+			if (other != color && neighbor.isValidColor(other)) {
+				neighbor.color = other;
+				node.color = color;
+				return color;
+			}
 		}
-		int *colorSet = new int[setSize+1];
-		colorSet[setSize] = -1;
-		int ind = 0;
-		// Now fill in the vertex indices.
-		for (it = this->nodes.begin(); it != this->nodes.end(); it++) {
-			int color = it->getColor();
-			if (color == currentColor)
-				colorSet[ind++] = it->getIndex();
+	}
+
+	this->colorDSATUR();
+	return node.color;
+}
+
+// If nobody has a color anymore, the highest color takes its place so the colors stay 0 .. n - 1.
+// Everyone with the highest color can safely move, nobody next to them has the empty one.
+
+void Graph::removeColorIfEmpty(int color) {
+	if (color < 0)
+		return;
+	int highest = -1;
+	NodeList::iterator it;
+	for (it = this->nodes.begin(); it != this->nodes.end(); it++) {
+		if (!it->alive)
+			continue;
+		if (it->color == color)
+			return;
+		highest = max(highest, it->color);
+	}
+	if (highest < color)
+		return;
+	for (it = this->nodes.begin(); it != this->nodes.end(); it++) {
+		if (it->alive && it->color == highest)
+			it->color = color;
+	}
+}
+
+// Adds a brush with the given index and AABB, and returns its color (-1 if the graph hasn't been
+// colored yet). If the index is already in the graph, the brush is moved instead.
+
+int Graph::addBrush(int index, AABB box) {
+	if (this->containsNode(index))
+		return this->moveBrush(index, box);
+	this->addNode(index);
+	int position = this->positions[index];
+	this->boxes[position] = box;
+	this->hasBox[position] = true;
+	this->linkBox(position);
+	this->compactIfNeeded();
+	if (!this->colored)
+		return -1;
+	return this->repairColor(position);
+}
+
+// Removes a brush and its edges. Taking nodes out never makes a coloring invalid, the only thing
+// to tidy up is a color with nobody left in it.
+
+void Graph::removeBrush(int index) {
+	GraphNode *node = this->findNode(index);
+	if (node == NULL)
+		return;
+	int color = node->color;
+	this->removeNode(node);
+	if (this->colored)
+		this->removeColorIfEmpty(color);
+}
+
+// Gives a brush a new AABB, and returns its color. The brush keeps its color if it still can.
+
+int Graph::moveBrush(int index, AABB box) {
+	GraphNode *node = this->findNode(index);
+	if (node == NULL)
+		return this->addBrush(index, box);
+	int position = node->position;
+	this->unlinkAll(position);
+	this->boxes[position] = box;
+	this->hasBox[position] = true;
+	this->linkBox(position);
+	this->compactIfNeeded();
+	if (!this->colored)
+		return -1;
+
+	int color = node->color;
+	if (color >= 0 && node->isValidColor(color))
+		return color;
+	this->repairColor(position);
+	this->removeColorIfEmpty(color);
+	return this->nodes[position].color;
+}
+
+// Clears all vertex colors and attempts to find a minimal coloring using the DSATUR algorithm.
+// We pick as follows: an uncolored node with the highest saturation. In the case of a tie, choose
+// the node with the highest degree. If a tie still exists, we choose the first such node in the
+// vector. The node gets the lowest color none of its neighbors have. The actual work is done by
+// colorDSATUR in coloring.cpp, which keeps the saturations up to date as it goes instead of
+// recounting them for every node on every step.
+
+void Graph::colorDSATUR() {
+	this->compact();
+	int count = (int)this->nodes.size();
+	if (count == 0)
+		return;
+	vector<int> colors(count);
+	::colorDSATUR(count, this->adjacency.getOffsets(), this->adjacency.getTargets(), &colors[0]);
+	// Dead nodes have no edges, so they never changed anyone's color. They just stay uncolored.
+	for (int i = 0; i < count; i++)
+		this->nodes[i].setColor(this->nodes[i].alive ? colors[i] : -1);
+	this->colored = true;
+}
+
+// The same colors DSATUR would pick, found one connected component at a time on the pool, with
+// each component's colors swapped around to spread the classes out evenly. See colorComponents
+// in coloring.cpp.
+
+void Graph::colorComponents(ThreadPool *pool) {
+	this->compact();
+	int count = (int)this->nodes.size();
+	if (count == 0)
+		return;
+	vector<int> colors(count);
+	::colorComponents(count, this->adjacency.getOffsets(), this->adjacency.getTargets(), &colors[0], pool);
+	// Dead nodes are components of their own, but they only ever fill in a class someone else
+	// started, so they can go without a color like always.
+	for (int i = 0; i < count; i++)
+		this->nodes[i].setColor(this->nodes[i].alive ? colors[i] : -1);
+	this->colored = true;
+}
+
+// Colors the graph on the pool instead, with colorParallel in coloring.cpp. The colors depend on
+// the seed but not on the pool, and there are usually a color or two more than DSATUR finds.
+
+void Graph::colorParallel(ThreadPool *pool, unsigned seed) {
+	this->compact();
+	int count = (int)this->nodes.size();
+	if (count == 0)
+		return;
+	vector<int> colors(count);
+	::colorParallel(count, this->adjacency.getOffsets(), this->adjacency.getTargets(), &colors[0], pool, seed);
+	// Dead nodes have no edges, so they all get color 0, which some live node always has too.
+	for (int i = 0; i < count; i++)
+		this->nodes[i].setColor(this->nodes[i].alive ? colors[i] : -1);
+	this->colored = true;
+}
+
+// Colors the graph for locality instead: every node takes whichever valid color's class bounds grow
+// least with it, so each class (and so each split map) stays in as small a part of the level as
+// it can. regions, if there are any, are by brush index; see colorDSATURLocal in coloring.cpp.
+// Nodes without an AABB are treated as a point at the origin.
+
+void Graph::colorDSATURLocal(const vector<int> *regions) {
+	this->compact();
+	int count = (int)this->nodes.size();
+	if (count == 0)
+		return;
+	vector<double> bounds((size_t)count * 6, 0);
+	vector<int> nodeRegions;
+	this->getNodeRegions(regions, nodeRegions);
+	for (int i = 0; i < count; i++) {
+		if (i < (int)this->hasBox.size() && this->hasBox[i]) {
+			for (int axis = 0; axis < 3; axis++) {
+				bounds[i * 6 + axis] = this->boxes[i].getMin(axis);
+				bounds[i * 6 + axis + 3] = this->boxes[i].getMax(axis);
+			}
 		}
-		// Finally, add this color set to the outer array.
-		colorSets[currentColor] = colorSet;
 	}
-	// Return the final array.
-	return colorSets;
+	vector<int> colors(count);
+	::colorDSATURLocal(count, this->adjacency.getOffsets(), this->adjacency.getTargets(), &bounds[0], regions != NULL ? &nodeRegions[0] : NULL, &colors[0]);
+	// Dead nodes have no edges, but they can still start a new color if they're first in a region.
+	// Renumbering the colors the live nodes have gets rid of any that only dead nodes ended up with.
+	vector<int> renumbered(count, -1);
+	int colorCount = 0;
+	for (int i = 0; i < count; i++) {
+		if (this->nodes[i].alive && renumbered[colors[i]] == -1)
+			renumbered[colors[i]] = 0;
+	}
+	for (int color = 0; color < count; color++) {
+		if (renumbered[color] == 0)
+			renumbered[color] = colorCount++;
+	}
+	for (int i = 0; i < count; i++)
+		this->nodes[i].setColor(this->nodes[i].alive ? renumbered[colors[i]] : -1);
+	this->colored = true;
+}
+
+// Looks up each node's region from a region per brush index. Dead nodes go in region 0, where
+// they can't get in anyone's way since they have no edges.
+
+void Graph::getNodeRegions(const vector<int> *regions, vector<int> &nodeRegions) {
+	nodeRegions.assign(this->nodes.size(), 0);
+	if (regions == NULL)
+		return;
+	for (size_t i = 0; i < this->nodes.size(); i++) {
+		if (this->nodes[i].alive)
+			nodeRegions[i] = (*regions)[this->nodes[i].getIndex()];
+	}
+}
+
+// Spends up to the budget looking for a coloring with fewer colors (see improveColoring in
+// coloring.cpp). The graph must be colored first. It keeps its coloring if nothing better turns
+// up. regions has a region for each brush index, as for colorDSATURLocal, or is NULL; with it, no
+// class ends up spanning two regions. Returns how many colors were saved.
+
+int Graph::improveColoring(const ColoringBudget &budget, const vector<int> *regions) {
+	if (!this->colored)
+		return 0;
+	this->compact();
+	int count = (int)this->nodes.size();
+	if (count == 0)
+		return 0;
+	// Dead nodes have no edges, so they can sit in any class while the search runs.
+	vector<int> colors(count);
+	vector<int> nodeRegions;
+	this->getNodeRegions(regions, nodeRegions);
+	int before = 0;
+	for (int i = 0; i < count; i++) {
+		colors[i] = (this->nodes[i].alive ? this->nodes[i].getColor() : 0);
+		before = max(before, colors[i] + 1);
+	}
+	int after = ::improveColoring(count, this->adjacency.getOffsets(), this->adjacency.getTargets(), regions != NULL ? &nodeRegions[0] : NULL, &colors[0], budget);
+	for (int i = 0; i < count; i++)
+		this->nodes[i].setColor(this->nodes[i].alive ? colors[i] : -1);
+	return before - after;
+}
+
+// Evens out the color classes, and keeps them under capacity if it isn't 0, adding colors only
+// when it must (see balanceColoring in coloring.cpp). weights holds a weight for each brush index,
+// or is NULL to just count nodes. regions is as for improveColoring. The graph must be colored
+// first. Returns the number of colors.
+
+int Graph::balanceColoring(const vector<int> *weights, long capacity, const vector<int> *regions) {
+	if (!this->colored)
+		return 0;
+	this->compact();
+	int count = (int)this->nodes.size();
+	if (count == 0)
+		return 0;
+	// Dead nodes weigh nothing, so wherever they sit doesn't matter.
+	vector<int> colors(count);
+	vector<int> nodeWeights(count, 0);
+	vector<int> nodeRegions;
+	this->getNodeRegions(regions, nodeRegions);
+	for (int i = 0; i < count; i++) {
+		if (!this->nodes[i].alive)
+			continue;
+		colors[i] = this->nodes[i].getColor();
+		nodeWeights[i] = (weights != NULL ? max((*weights)[this->nodes[i].getIndex()], 1) : 1);
+	}
+	int colorCount = ::balanceColoring(count, this->adjacency.getOffsets(), this->adjacency.getTargets(), &nodeWeights[0], regions != NULL ? &nodeRegions[0] : NULL, &colors[0], capacity);
+	for (int i = 0; i < count; i++)
+		this->nodes[i].setColor(this->nodes[i].alive ? colors[i] : -1);
+	return colorCount;
+}
+
+// Gets the sets of indices: class i of the partition has the indices of every node colored i, in
+// node order, and together they partition the graph. Returns an empty partition if any live node
+// isn't colored yet.
+
+Partition Graph::getPartition() {
+	Partition partition;
+	NodeList::iterator it;
+	for (it = this->nodes.begin(); it != this->nodes.end(); it++) {
+		if (it->alive && it->getColor() < 0)
+			return partition; // The graph must be fully colored first!
+	}
+	partition.build(this->nodes.size(), [this](size_t i) {
+		return this->nodes[i].alive ? this->nodes[i].getColor() : -1;
+	}, [this](size_t i) {
+		return this->nodes[i].getIndex();
+	});
+	return partition;
+}
+
+// Hands the AABBs the graph was made with back, by position, so they don't have to be copied in
+// and out again. Brushes can't be added or moved (or colored for locality) afterwards.
+
+void Graph::releaseBoxes(vector<AABB> &boxes) {
+	boxes = std::move(this->boxes);
+	this->boxes.clear();
+	this->hasBox.assign(this->hasBox.size(), false);
 }
 
 // Creates an AABB with the specified coordinates.
@@ -336,6 +789,24 @@ AABB::AABB(double x1, double y1, double z1, double x2, double y2, double z2) {
 
 }
 
+// Returns the lower or upper coordinate of this AABB along an axis (0 = x, 1 = y, 2 = z).
+
+double AABB::getMin(int axis) {
+	switch (axis) {
+		case 0: return this->x1;
+		case 1: return this->y1;
+		default: return this->z1;
+	}
+}
+
+double AABB::getMax(int axis) {
+	switch (axis) {
+		case 0: return this->x2;
+		case 1: return this->y2;
+		default: return this->z2;
+	}
+}
+
 // Returns whether the given AABBs overlap at all.
 
 bool AABB::intersects (AABB *other) {
@@ -387,26 +858,40 @@ vector<AABB> getAABBs(char *fname) {
 	return vec;
 }
 
-// Builds the collision graph for a given vector of AABBs.
-
-Graph getCollisions(vector<AABB> AABBs) {
-	vector<AABB>::iterator it1, it2;
-	int i, j;
-	Graph graph;
-	for (i = 0; i < AABBs.size(); i++)
-		graph.addNode(i);
-	i = 0;
-	for (it1 = AABBs.begin(); it1 != AABBs.end(); it1++) {
-		j = 0;
-		for (it2 = AABBs.begin(); it2 != it1; it2++) {
-			if (it1->intersects(&(*it2))) {
-				graph.addEdge(i,j);
-			}
-			j++;
+// Builds the collision graph for a given vector of AABBs. The broad phase only decides which pairs
+// get looked at; the edges come out the same whichever one is used, and however many threads the
+// pool has. Each thread collects its own pairs and they all go into the graph in one go at the end.
+
+Graph getCollisions(vector<AABB> AABBs, BroadPhase method, ThreadPool *pool) {
+	vector<pair<int, int> > pairs;
+	findOverlaps(AABBs, method, pairs, pool);
+	return Graph(std::move(AABBs), pairs);
+}
+
+// Splits the level into regionCount regions of (nearly) the same number of brushes. Brushes are
+// put in Morton order by their centers, which keeps brushes that are near each other mostly near
+// each other in the order too, and the order is cut into even runs. regions[i] is brush i's region.
+
+void getRegions(vector<AABB> &AABBs, int regionCount, vector<int> &regions) {
+	size_t count = AABBs.size();
+	regions.assign(count, 0);
+	if (count == 0 || regionCount <= 1)
+		return;
+
+	vector<double> bounds(count * 6);
+	for (size_t i = 0; i < count; i++) {
+		for (int axis = 0; axis < 3; axis++) {
+			bounds[i * 6 + axis] = AABBs[i].getMin(axis);
+			bounds[i * 6 + axis + 3] = AABBs[i].getMax(axis);
 		}
-		i++;
 	}
-	return graph;
+	vector<int> order(count);
+	getMortonOrder((int)count, &bounds[0], &order[0]);
+
+	if ((size_t)regionCount > count)
+		regionCount = (int)count;
+	for (size_t i = 0; i < count; i++)
+		regions[order[i]] = (int)(i * regionCount / count);
 }
 
 // Tests the algorithm with the Petersen graph.
@@ -437,12 +922,13 @@ Graph getCollisions(vector<AABB> AABBs) {
 //	cout << petersen.findNode(0)->getDegree() << endl;
 //	// Perform and display the coloring.
 //	petersen.colorDSATUR();
-//	int **colorSets = petersen.getColorSets();
-//	for (int i = 0; colorSets[i] != NULL; i++) {
+//	Partition colorSets = petersen.getPartition();
+//	for (size_t i = 0; i < colorSets.getClassCount(); i++) {
 //		cout << "Color " << i << ": vertices ";
-//		for (int j = 0; colorSets[i][j] != -1; j++) {
+//		PartitionClass colorSet = colorSets.getClass(i);
+//		for (size_t j = 0; j < colorSet.size(); j++) {
 //			if (j > 0) cout << ", ";
-//			cout << colorSets[i][j];
+//			cout << colorSet[j];
 //		}
 //		cout << endl;
 //	}
@@ -463,12 +949,13 @@ Graph getCollisions(vector<AABB> AABBs) {
 //	cout << large.findNode(0)->getDegree() << endl;
 //	// Perform and display the coloring.
 //	large.colorDSATUR();
-//	int **colorSets = large.getColorSets();
-//	for (int i = 0; colorSets[i] != NULL; i++) {
+//	Partition colorSets = large.getPartition();
+//	for (size_t i = 0; i < colorSets.getClassCount(); i++) {
 //		cout << "Color " << i << ": vertices ";
-//		for (int j = 0; colorSets[i][j] != -1; j++) {
+//		PartitionClass colorSet = colorSets.getClass(i);
+//		for (size_t j = 0; j < colorSet.size(); j++) {
 //			if (j > 0) cout << ", ";
-//			cout << colorSets[i][j];
+//			cout << colorSet[j];
 //		}
 //		cout << endl;
 //	}
@@ -482,12 +969,13 @@ Graph getCollisions(vector<AABB> AABBs) {
 //	cout << graph->findNode(0)->getDegree() << endl;
 //	// Perform and display the coloring.
 //	graph->colorDSATUR();
-//	int **colorSets = graph->getColorSets();
-//	for (int i = 0; colorSets[i] != NULL; i++) {
+//	Partition colorSets = graph->getPartition();
+//	for (size_t i = 0; i < colorSets.getClassCount(); i++) {
 //		cout << "Color " << i << ": vertices ";
-//		for (int j = 0; colorSets[i][j] != -1; j++) {
+//		PartitionClass colorSet = colorSets.getClass(i);
+//		for (size_t j = 0; j < colorSet.size(); j++) {
 //			if (j > 0) cout << ", ";
-//			cout << colorSets[i][j];
+//			cout << colorSet[j];
 //		}
 //		cout << endl;
 //	}
@@ -500,7 +988,7 @@ Graph getCollisions(vector<AABB> AABBs) {
 //	}
 //	clock_t startTime = clock();
 //	vector<AABB> AABBs = getAABBs(argv[1]);
-//	Graph graph = getCollisions(AABBs);
+//	Graph graph = getCollisions(std::move(AABBs));
 //	testGraph(&graph);
 //	cout << "Execution took " << double( clock() - startTime ) * 1000.0 / (double)CLOCKS_PER_SEC << " ms" << endl;
 //	return 0;
@@ -28,20 +28,47 @@
 // if multiple objects intersect. With this program, one can produce groups of meshes that have no
 // intersections, then combine them some safer way.
 
-// The GraphNode class. Used for the individual nodes in the collision graph.
+#ifndef __MBMapSplitter__aabbcolor__
+#define __MBMapSplitter__aabbcolor__
 
+#include <deque>
+#include <memory>
+#include <unordered_map>
 #include <vector>
+#include "arena.h"
+#include "coloring.h"
+#include "csrgraph.h"
+#include "partition.h"
 
 using namespace std;
 
+// The AABB class provides a bit of a wrapper for the AABBs themselves. Nothing fancy.
+
+class AABB {
+private:
+	double x1, y1, z1, x2, y2, z2;
+public:
+	AABB(double x1, double y1, double z1, double x2, double y2, double z2);
+	double getMin(int axis);
+	double getMax(int axis);
+	bool intersects(AABB *other);
+};
+
+// The GraphNode class. Used for the individual nodes in the collision graph. The edges themselves
+// live in the graph, so a node is really just an index and a color with a way back to its graph.
+
+class Graph;
+
 class GraphNode {
 private:
+	Graph *graph;
+	int position;
 	int index;
 	int color;
-	vector<GraphNode*> neighbors;
-	void vectorRemove(GraphNode *node);
+	bool alive;
+	friend class Graph;
 public:
-	GraphNode(int index);
+	GraphNode(Graph *graph, int position, int index);
 	int getIndex();
 	void setIndex(int index);
 	int getColor();
@@ -55,36 +82,97 @@ public:
 };
 
 // The Graph class. Used to represent a graph of which AABBs collide, which is then colored.
+// Edges are kept in a CSRGraph over node positions. Editing a node's edges copies just that node's
+// neighbor list out to the side and changes it there, so an edit only costs as much as the nodes it
+// touches; the copies are folded back into the CSRGraph once enough of them pile up, or when the
+// whole graph is needed at once. The fastest way to build a graph is still to hand the whole edge
+// list to the constructor.
+// Nodes are never moved once created (removed ones are only marked dead), so GraphNode pointers
+// stay valid for the life of the graph.
+// A graph made by getCollisions also remembers each node's AABB, so brushes can be added, removed
+// and moved afterwards. Once the graph has been colored, each of these edits repairs the coloring
+// around the brush it touched instead of starting over.
+// The nodes and the index lookup come out of the graph's own arena, rather than one allocation per
+// node, and the arena goes when the graph does.
 
 class Graph {
 private:
-	vector<GraphNode> nodes;
+	typedef deque<GraphNode, ArenaAllocator<GraphNode> > NodeList;
+	typedef unordered_map<int, int, hash<int>, equal_to<int>, ArenaAllocator<pair<const int, int> > > PositionMap;
+	unique_ptr<Arena> arena;
+	NodeList nodes;
+	PositionMap positions;
+	int liveCount;
+	CSRGraph adjacency;
+	unordered_map<int, vector<int> > changedNeighbors;
+	size_t edgeCount;
+	vector<AABB> boxes;
+	vector<bool> hasBox;
+	bool colored;
+	void attachNodes();
+	void resetArena();
+	const int *neighborsBegin(int position);
+	const int *neighborsEnd(int position);
+	vector<int> &editNeighbors(int position);
+	bool link(int position1, int position2);
+	bool unlink(int position1, int position2);
+	void unlinkAll(int position);
+	void compact();
+	void compactIfNeeded();
+	void linkBox(int position);
+	int getColorCount();
+	int repairColor(int position);
+	void removeColorIfEmpty(int color);
+	void getNodeRegions(const vector<int> *regions, vector<int> &nodeRegions);
+	friend class GraphNode;
 public:
 	Graph();
+	Graph(int size, const vector<pair<int, int> > &edges);
+	Graph(vector<AABB> boxes, const vector<pair<int, int> > &edges);
+	Graph(const Graph &other);
+	Graph(Graph &&other);
+	Graph &operator=(const Graph &other);
+	Graph &operator=(Graph &&other);
 	int addNode(int index);
 	int removeNode(int index);
 	int removeNode(GraphNode *node);
 	bool containsNode(int index);
 	GraphNode *findNode(int index);
+	bool getBox(int index, AABB &box);
 	int getSize();
 	void addEdge(int index1, int index2);
 	void removeEdge(int index1, int index2);
 	bool isEdge(int index1, int index2);
 	int getEdgeCount();
+	const CSRGraph &getAdjacency();
+	int addBrush(int index, AABB box);
+	void removeBrush(int index);
+	int moveBrush(int index, AABB box);
 	void colorDSATUR();
-	int **getColorSets();
+	void colorComponents(ThreadPool *pool);
+	void colorParallel(ThreadPool *pool, unsigned seed);
+	void colorDSATURLocal(const vector<int> *regions);
+	int improveColoring(const ColoringBudget &budget, const vector<int> *regions);
+	int balanceColoring(const vector<int> *weights, long capacity, const vector<int> *regions);
+	Partition getPartition();
+	void releaseBoxes(vector<AABB> &boxes);
 };
 
-// The AABB class provides a bit of a wrapper for the AABBs themselves. Nothing fancy.
+// The broad-phase strategies getCollisions can use to find the intersecting pairs. Every strategy
+// produces exactly the same edges; they only differ in how many pairs they have to look at.
 
-class AABB {
-private:
-	double x1, y1, z1, x2, y2, z2;
-public:
-	AABB(double x1, double y1, double z1, double x2, double y2, double z2);
-	bool intersects(AABB *other);
+enum BroadPhase {
+	BroadPhaseAuto,
+	BroadPhaseBruteForce,
+	BroadPhaseSweep,
+	BroadPhaseGrid
 };
 
-Graph getCollisions(vector<AABB> AABBs);
+class ThreadPool;
+
+Graph getCollisions(vector<AABB> AABBs, BroadPhase method = BroadPhaseAuto, ThreadPool *pool = NULL);
+void getRegions(vector<AABB> &AABBs, int regionCount, vector<int> &regions);
 vector<AABB> getAABBs(char *fname);
 vector<AABB> getAABBs(double **coords);
+
+#endif
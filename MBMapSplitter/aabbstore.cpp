@@ -0,0 +1,262 @@
+//
+//  aabbstore.cpp
+//  MBMapSplitter
+//
+//  Copyright (c) 2015 HiGuy Smith
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#include <algorithm>
+#include <cmath>
+#include "aabbstore.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__)) && defined(__SSE2__)
+#define AABBSTORE_X86 1
+#include <immintrin.h>
+#endif
+
+// Columns 0-2 hold x1, y1, z1 and columns 3-5 hold x2, y2, z2. Every column has this many spare
+// entries on the end so that a batch near the end can be loaded whole.
+#define COLUMN_PADDING 8
+
+// A kernel tests query against boxes begin .. begin + count - 1 (count is at most 8) and returns a
+// mask with bit i set if box begin + i intersects. Every version makes the same comparisons as
+// AABB::intersects: a box is missed only if some minimum is greater than the other's maximum. The
+// SIMD comparisons used are the ordered ones, which are false for NaN just like > and < are.
+
+template <typename T>
+static unsigned scalarKernel(const T *query, const T *const *columns, size_t begin, size_t count) {
+	unsigned mask = 0;
+	for (size_t i = 0; i < count; i++) {
+		size_t box = begin + i;
+		if (query[0] > columns[3][box]) continue;
+		if (query[3] < columns[0][box]) continue;
+		if (query[1] > columns[4][box]) continue;
+		if (query[4] < columns[1][box]) continue;
+		if (query[2] > columns[5][box]) continue;
+		if (query[5] < columns[2][box]) continue;
+		mask |= 1u << i;
+	}
+	return mask;
+}
+
+#ifdef AABBSTORE_X86
+
+static unsigned sse2DoubleKernel(const double *query, const double *const *columns, size_t begin, size_t count) {
+	unsigned mask = 0;
+	for (size_t i = 0; i < count; i += 2) {
+		__m128d miss = _mm_setzero_pd();
+		for (int axis = 0; axis < 3; axis++) {
+			miss = _mm_or_pd(miss, _mm_cmpgt_pd(_mm_set1_pd(query[axis]), _mm_loadu_pd(columns[axis + 3] + begin + i)));
+			miss = _mm_or_pd(miss, _mm_cmplt_pd(_mm_set1_pd(query[axis + 3]), _mm_loadu_pd(columns[axis] + begin + i)));
+		}
+		mask |= (unsigned)(~_mm_movemask_pd(miss) & 0x3) << i;
+	}
+	return mask & ((1u << count) - 1);
+}
+
+static unsigned sse2FloatKernel(const float *query, const float *const *columns, size_t begin, size_t count) {
+	unsigned mask = 0;
+	for (size_t i = 0; i < count; i += 4) {
+		__m128 miss = _mm_setzero_ps();
+		for (int axis = 0; axis < 3; axis++) {
+			miss = _mm_or_ps(miss, _mm_cmpgt_ps(_mm_set1_ps(query[axis]), _mm_loadu_ps(columns[axis + 3] + begin + i)));
+			miss = _mm_or_ps(miss, _mm_cmplt_ps(_mm_set1_ps(query[axis + 3]), _mm_loadu_ps(columns[axis] + begin + i)));
+		}
+		mask |= (unsigned)(~_mm_movemask_ps(miss) & 0xF) << i;
+	}
+	return mask & ((1u << count) - 1);
+}
+
+__attribute__((target("avx2")))
+static unsigned avx2DoubleKernel(const double *query, const double *const *columns, size_t begin, size_t count) {
+	unsigned mask = 0;
+	for (size_t i = 0; i < count; i += 4) {
+		__m256d miss = _mm256_setzero_pd();
+		for (int axis = 0; axis < 3; axis++) {
+			miss = _mm256_or_pd(miss, _mm256_cmp_pd(_mm256_set1_pd(query[axis]), _mm256_loadu_pd(columns[axis + 3] + begin + i), _CMP_GT_OQ));
+			miss = _mm256_or_pd(miss, _mm256_cmp_pd(_mm256_set1_pd(query[axis + 3]), _mm256_loadu_pd(columns[axis] + begin + i), _CMP_LT_OQ));
+		}
+		mask |= (unsigned)(~_mm256_movemask_pd(miss) & 0xF) << i;
+	}
+	return mask & ((1u << count) - 1);
+}
+
+__attribute__((target("avx2")))
+static unsigned avx2FloatKernel(const float *query, const float *const *columns, size_t begin, size_t count) {
+	__m256 miss = _mm256_setzero_ps();
+	for (int axis = 0; axis < 3; axis++) {
+		miss = _mm256_or_ps(miss, _mm256_cmp_ps(_mm256_set1_ps(query[axis]), _mm256_loadu_ps(columns[axis + 3] + begin), _CMP_GT_OQ));
+		miss = _mm256_or_ps(miss, _mm256_cmp_ps(_mm256_set1_ps(query[axis + 3]), _mm256_loadu_ps(columns[axis] + begin), _CMP_LT_OQ));
+	}
+	unsigned mask = (unsigned)(~_mm256_movemask_ps(miss) & 0xFF);
+	return mask & ((1u << count) - 1);
+}
+
+#endif
+
+// Picks the best kernels this CPU can run, once.
+
+typedef unsigned (*DoubleKernel)(const double *, const double *const *, size_t, size_t);
+typedef unsigned (*FloatKernel)(const float *, const float *const *, size_t, size_t);
+
+struct Kernels {
+	DoubleKernel doubleKernel;
+	FloatKernel floatKernel;
+	const char *name;
+
+	Kernels() {
+		this->doubleKernel = scalarKernel<double>;
+		this->floatKernel = scalarKernel<float>;
+		this->name = "scalar";
+#ifdef AABBSTORE_X86
+		this->doubleKernel = sse2DoubleKernel;
+		this->floatKernel = sse2FloatKernel;
+		this->name = "sse2";
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2")) {
+			this->doubleKernel = avx2DoubleKernel;
+			this->floatKernel = avx2FloatKernel;
+			this->name = "avx2";
+		}
+#endif
+	}
+};
+
+static const Kernels &getKernels() {
+	static Kernels kernels;
+	return kernels;
+}
+
+// Creates an empty store.
+
+AABBStore::AABBStore() {
+	this->count = 0;
+	this->useFloat = false;
+}
+
+// Creates a store holding the given boxes in the same order.
+
+AABBStore::AABBStore(vector<AABB> &AABBs) {
+	this->assign(AABBs);
+}
+
+void AABBStore::assign(vector<AABB> &AABBs) {
+	vector<int> order(AABBs.size());
+	for (size_t i = 0; i < AABBs.size(); i++)
+		order[i] = (int)i;
+	this->assign(AABBs, order.data(), order.size());
+}
+
+// Fills the store with AABBs[order[0]], AABBs[order[1]], ... A box can appear more than once.
+
+void AABBStore::assign(vector<AABB> &AABBs, const int *order, size_t count) {
+	this->count = count;
+	this->useFloat = true;
+	for (size_t i = 0; i < count && this->useFloat; i++) {
+		AABB &box = AABBs[order[i]];
+		for (int axis = 0; axis < 3; axis++) {
+			double low = box.getMin(axis), high = box.getMax(axis);
+			if ((!std::isnan(low) && (double)(float)low != low) || (!std::isnan(high) && (double)(float)high != high))
+				this->useFloat = false;
+		}
+	}
+
+	// Only one copy is kept: the floats if they can stand in for the doubles, else the doubles.
+	for (int column = 0; column < 6; column++) {
+		if (this->useFloat) {
+			vector<double>().swap(this->columns[column]);
+			this->fillColumn(this->floatColumns[column], AABBs, order, column);
+		} else {
+			vector<float>().swap(this->floatColumns[column]);
+			this->fillColumn(this->columns[column], AABBs, order, column);
+		}
+	}
+}
+
+template <typename T>
+void AABBStore::fillColumn(vector<T> &values, vector<AABB> &AABBs, const int *order, int column) {
+	values.assign(this->count + COLUMN_PADDING, 0);
+	for (size_t i = 0; i < this->count; i++) {
+		AABB &box = AABBs[order[i]];
+		values[i] = (T)(column < 3 ? box.getMin(column) : box.getMax(column - 3));
+	}
+}
+
+// Returns how many boxes are in the store.
+
+size_t AABBStore::size() const {
+	return this->count;
+}
+
+// Returns whether the boxes are being tested as floats.
+
+bool AABBStore::usesFloat() const {
+	return this->useFloat;
+}
+
+// Returns a coordinate of a box in the store.
+
+double AABBStore::getMin(size_t box, int axis) const {
+	return (this->useFloat ? this->floatColumns[axis][box] : this->columns[axis][box]);
+}
+
+double AABBStore::getMax(size_t box, int axis) const {
+	return (this->useFloat ? this->floatColumns[axis + 3][box] : this->columns[axis + 3][box]);
+}
+
+// Returns the first box in [begin, end) whose minimum along axis is greater than value, or end if
+// there isn't one. The minimums along axis have to be sorted over that range.
+
+size_t AABBStore::upperBoundMin(int axis, size_t begin, size_t end, double value) const {
+	if (this->useFloat) {
+		const float *starts = this->floatColumns[axis].data();
+		return upper_bound(starts + begin, starts + end, value, [](double a, float b) { return a < b; }) - starts;
+	}
+	const double *starts = this->columns[axis].data();
+	return upper_bound(starts + begin, starts + end, value) - starts;
+}
+
+// Tests box query against boxes begin .. begin + count - 1, where count is at most 8. Bit i of the
+// result is set if box begin + i intersects it.
+
+unsigned AABBStore::intersectMask(size_t query, size_t begin, size_t count) const {
+	if (this->useFloat) {
+		float box[6];
+		const float *columns[6];
+		for (int column = 0; column < 6; column++) {
+			box[column] = this->floatColumns[column][query];
+			columns[column] = this->floatColumns[column].data();
+		}
+		return getKernels().floatKernel(box, columns, begin, count);
+	}
+	double box[6];
+	const double *columns[6];
+	for (int column = 0; column < 6; column++) {
+		box[column] = this->columns[column][query];
+		columns[column] = this->columns[column].data();
+	}
+	return getKernels().doubleKernel(box, columns, begin, count);
+}
+
+// Returns which kernels are in use, for reports.
+
+const char *AABBStore::getKernelName() {
+	return getKernels().name;
+}
@@ -0,0 +1,75 @@
+//
+//  aabbstore.h
+//  MBMapSplitter
+//
+//  Copyright (c) 2015 HiGuy Smith
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#ifndef __MBMapSplitter__aabbstore__
+#define __MBMapSplitter__aabbstore__
+
+#include <stddef.h>
+#include <vector>
+#include "aabbcolor.h"
+
+// A batch of AABBs stored structure-of-arrays style: one array per coordinate, so that one box can
+// be tested against several others at once with SIMD. If every coordinate survives the trip to a
+// float unchanged, the boxes are stored as floats instead, so they take half the memory and twice
+// as many are tested per instruction.
+// The answers are exactly those of AABB::intersects either way (touching still counts).
+
+class AABBStore {
+private:
+	size_t count;
+	bool useFloat;
+	vector<double> columns[6];
+	vector<float> floatColumns[6];
+
+	template <typename T>
+	void fillColumn(vector<T> &values, vector<AABB> &AABBs, const int *order, int column);
+public:
+	AABBStore();
+	AABBStore(vector<AABB> &AABBs);
+	void assign(vector<AABB> &AABBs);
+	void assign(vector<AABB> &AABBs, const int *order, size_t count);
+	size_t size() const;
+	bool usesFloat() const;
+	double getMin(size_t box, int axis) const;
+	double getMax(size_t box, int axis) const;
+	size_t upperBoundMin(int axis, size_t begin, size_t end, double value) const;
+	unsigned intersectMask(size_t query, size_t begin, size_t count) const;
+
+	// Calls found(box) for every box in [begin, end) that intersects the box query, in order.
+	template <typename Callback>
+	void forEachIntersecting(size_t query, size_t begin, size_t end, Callback found) const {
+		for (size_t batch = begin; batch < end; batch += 8) {
+			size_t batchCount = (end - batch < 8 ? end - batch : 8);
+			unsigned mask = this->intersectMask(query, batch, batchCount);
+			for (size_t i = 0; mask != 0; i++, mask >>= 1) {
+				if (mask & 1)
+					found(batch + i);
+			}
+		}
+	}
+
+	static const char *getKernelName();
+};
+
+#endif
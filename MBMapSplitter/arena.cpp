@@ -0,0 +1,130 @@
+//
+//  arena.cpp
+//  MBMapSplitter
+//
+//  Copyright (c) 2015 HiGuy Smith
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#include "arena.h"
+
+#include <stdint.h>
+#include <cstdlib>
+
+#define ARENA_SMALL_STEP 16
+#define ARENA_SMALL_MAX (16 * ARENA_SMALL_STEP)
+
+Arena::Arena(size_t blockSize) : blockSize(blockSize), current(0), used(0), allocated(0) {
+	for (int i = 0; i < 16; i ++) {
+		freePieces[i] = NULL;
+	}
+}
+
+Arena::~Arena() {
+	for (size_t i = 0; i < blocks.size(); i ++) {
+		free(blocks[i].data);
+	}
+}
+
+void *Arena::allocate(size_t size, size_t alignment) {
+	if (size == 0) {
+		size = 1;
+	}
+
+	//Small pieces come back the same size they went out, so take one of those first
+	if (size <= ARENA_SMALL_MAX) {
+		size = (size + ARENA_SMALL_STEP - 1) & ~(size_t)(ARENA_SMALL_STEP - 1);
+	}
+	if (size <= ARENA_SMALL_MAX && alignment <= ARENA_SMALL_STEP) {
+		FreePiece *&list = freePieces[size / ARENA_SMALL_STEP - 1];
+		if (list != NULL) {
+			FreePiece *piece = list;
+			list = piece->next;
+			allocated += size;
+			return piece;
+		}
+	}
+
+	while (true) {
+		if (current < blocks.size()) {
+			Block &block = blocks[current];
+			uintptr_t next = (uintptr_t)(block.data + used);
+			size_t start = used + (size_t)(((next + alignment - 1) & ~(uintptr_t)(alignment - 1)) - next);
+			if (start + size <= block.size) {
+				used = start + size;
+				allocated += size;
+				return block.data + start;
+			}
+			//Doesn't fit, on to the next one
+			current ++;
+			used = 0;
+			continue;
+		}
+
+		//Anything bigger than a block gets a block of its own
+		Block block;
+		block.size = std::max(blockSize, size + alignment);
+		block.data = (char *)malloc(block.size);
+		if (block.data == NULL) {
+			throw std::bad_alloc();
+		}
+		blocks.push_back(block);
+		current = blocks.size() - 1;
+		used = 0;
+	}
+}
+
+void Arena::release(void *memory, size_t size) {
+	if (memory == NULL) {
+		return;
+	}
+	if (size == 0) {
+		size = 1;
+	}
+	size = (size + ARENA_SMALL_STEP - 1) & ~(size_t)(ARENA_SMALL_STEP - 1);
+	allocated -= std::min(allocated, size);
+	if (size > ARENA_SMALL_MAX) {
+		return;
+	}
+	FreePiece *piece = (FreePiece *)memory;
+	FreePiece *&list = freePieces[size / ARENA_SMALL_STEP - 1];
+	piece->next = list;
+	list = piece;
+}
+
+void Arena::reset() {
+	if (blocks.size() > 1) {
+		for (size_t i = 1; i < blocks.size(); i ++) {
+			free(blocks[i].data);
+		}
+		blocks.resize(1);
+	}
+	for (int i = 0; i < 16; i ++) {
+		freePieces[i] = NULL;
+	}
+	current = 0;
+	used = 0;
+	allocated = 0;
+}
+
+ScratchArenas::ScratchArenas(int slots, size_t blockSize) {
+	for (int i = 0; i < slots; i ++) {
+		arenas.push_back(std::unique_ptr<Arena>(new Arena(blockSize)));
+	}
+}
@@ -0,0 +1,161 @@
+//
+//  arena.h
+//  MBMapSplitter
+//
+//  Copyright (c) 2015 HiGuy Smith
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#ifndef __MBMapSplitter__arena__
+#define __MBMapSplitter__arena__
+
+#include <stddef.h>
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <vector>
+
+//A region allocator. Memory comes out of big blocks a pointer bump at a time and all goes back in
+//one go when the arena is reset or destroyed, so a map's worth of scratch costs a handful of real
+//allocations instead of one per brush. Small pieces that are given back early are kept on a free
+//list by size and handed out again, so something that lives a long time and keeps changing (a
+//graph being edited) doesn't grow without end.
+//An arena isn't thread safe. Give each thread its own (see ScratchArenas).
+class Arena {
+	struct Block {
+		char *data;
+		size_t size;
+	};
+	struct FreePiece {
+		FreePiece *next;
+	};
+
+	std::vector<Block> blocks;
+	size_t blockSize;
+	size_t current;
+	size_t used;
+	size_t allocated;
+	//Free lists for pieces up to 256 bytes, in 16 byte steps
+	FreePiece *freePieces[16];
+
+	Arena(const Arena &other) = delete;
+	Arena &operator=(const Arena &other) = delete;
+public:
+	Arena(size_t blockSize = 1 << 20);
+	~Arena();
+
+	void *allocate(size_t size, size_t alignment = 16);
+	//Gives back a piece, for reuse if it's small. Big pieces just wait for the reset.
+	void release(void *memory, size_t size);
+	//Everything handed out is gone. The first block is kept to go again with.
+	void reset();
+
+	//How much has been handed out since the last reset
+	size_t getAllocated() const { return allocated; }
+
+	template<typename T>
+	T *allocate(size_t count) {
+		return static_cast<T *>(allocate(count * sizeof(T), alignof(T)));
+	}
+};
+
+//For giving containers their memory from an arena. The arena has to outlive the container.
+template<typename T>
+class ArenaAllocator {
+	Arena *arena;
+
+	template<typename U> friend class ArenaAllocator;
+public:
+	typedef T value_type;
+	typedef std::true_type propagate_on_container_move_assignment;
+	typedef std::true_type propagate_on_container_swap;
+
+	ArenaAllocator(Arena *arena) : arena(arena) {}
+	template<typename U>
+	ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+
+	T *allocate(size_t count) {
+		return arena->allocate<T>(count);
+	}
+	void deallocate(T *memory, size_t count) {
+		arena->release(memory, count * sizeof(T));
+	}
+
+	Arena *getArena() const { return arena; }
+
+	template<typename U>
+	bool operator==(const ArenaAllocator<U> &other) const { return arena == other.arena; }
+	template<typename U>
+	bool operator!=(const ArenaAllocator<U> &other) const { return arena != other.arena; }
+};
+
+//A list you can only add to, kept in chunks from an arena. Nothing in it ever moves, so it grows
+//without copying what's already there.
+template<typename T>
+class ArenaList {
+	struct Chunk {
+		T *items;
+		size_t count;
+	};
+
+	Arena *arena;
+	std::vector<Chunk> chunks;
+	size_t capacity;
+	size_t total;
+public:
+	ArenaList(Arena *arena) : arena(arena), capacity(0), total(0) {}
+
+	void push_back(const T &item) {
+		if (chunks.empty() || chunks.back().count == capacity) {
+			//Chunks double, up to a point, so small lists stay small
+			capacity = std::min(std::max(capacity * 2, (size_t)256), (size_t)65536);
+			Chunk chunk = {arena->allocate<T>(capacity), 0};
+			chunks.push_back(chunk);
+		}
+		Chunk &chunk = chunks.back();
+		new (chunk.items + chunk.count) T(item);
+		chunk.count ++;
+		total ++;
+	}
+
+	size_t size() const { return total; }
+	bool empty() const { return total == 0; }
+
+	//Copies everything into output, which needs room for size() items
+	void copyTo(T *output) const {
+		for (size_t i = 0; i < chunks.size(); i ++) {
+			std::uninitialized_copy(chunks[i].items, chunks[i].items + chunks[i].count, output);
+			output += chunks[i].count;
+		}
+	}
+};
+
+//One arena for each thread of a pool, for per-thread scratch inside parallelFor (index it by the
+//slot you're given). They all go away with it.
+class ScratchArenas {
+	std::vector<std::unique_ptr<Arena> > arenas;
+public:
+	ScratchArenas(int slots, size_t blockSize = 1 << 20);
+
+	Arena &get(int slot) { return *arenas[slot]; }
+	int getSlotCount() const { return (int)arenas.size(); }
+};
+
+#endif
@@ -0,0 +1,378 @@
+//
+//  broadphase.cpp
+//  MBMapSplitter
+//
+//  Copyright (c) 2015 HiGuy Smith
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <stdint.h>
+#include "aabbstore.h"
+#include "arena.h"
+#include "broadphase.h"
+
+using namespace std;
+
+// Below this many boxes the brute-force loop beats any setup cost.
+#define BROADPHASE_MIN_BOXES 64
+// If the sweep would have to look at more than this many boxes per box, the grid wins.
+#define SWEEP_MAX_CANDIDATES 32.0
+// Boxes that cover more grid cells than this are tested against every box instead.
+#define GRID_MAX_CELLS 64
+// Cell coordinates are packed into 21 bits per axis, so the grid is at most this wide.
+#define GRID_AXIS_BITS 21
+#define GRID_AXIS_CELLS (1 << 20)
+
+// Whether all of a box's coordinates are finite and its minimum is not past its maximum. The
+// sweep and the grid both rely on this, anything else is handled the slow way.
+
+static bool isRegular(AABB &box) {
+	for (int axis = 0; axis < 3; axis ++) {
+		double min = box.getMin(axis);
+		double max = box.getMax(axis);
+		if (!std::isfinite(min) || !std::isfinite(max) || min > max)
+			return false;
+	}
+	return true;
+}
+
+// Finds the bounds and the average box size of every regular box. Returns how many there were.
+
+static int getSceneBounds(vector<AABB> &AABBs, double *lo, double *hi, double *avg) {
+	int count = 0;
+	for (int axis = 0; axis < 3; axis ++) {
+		lo[axis] = HUGE_VAL;
+		hi[axis] = -HUGE_VAL;
+		avg[axis] = 0;
+	}
+	for (size_t i = 0; i < AABBs.size(); i ++) {
+		if (!isRegular(AABBs[i]))
+			continue;
+		for (int axis = 0; axis < 3; axis ++) {
+			lo[axis] = min(lo[axis], AABBs[i].getMin(axis));
+			hi[axis] = max(hi[axis], AABBs[i].getMax(axis));
+			avg[axis] += AABBs[i].getMax(axis) - AABBs[i].getMin(axis);
+		}
+		count ++;
+	}
+	if (count > 0) {
+		for (int axis = 0; axis < 3; axis ++)
+			avg[axis] /= count;
+	}
+	return count;
+}
+
+// Each thread collects its pairs in its own list, out of its own arena, so nothing is shared while
+// testing and nothing gets copied as the lists grow. It all goes away at once when the search is
+// done.
+
+typedef pair<int, int> Pair;
+
+struct PairBuffers {
+	ScratchArenas arenas;
+	vector<ArenaList<Pair> > found;
+
+	PairBuffers(int slots) : arenas(slots) {
+		for (int i = 0; i < slots; i ++)
+			this->found.push_back(ArenaList<Pair>(&this->arenas.get(i)));
+	}
+};
+
+// Sorts every buffer (in parallel), then merges them pairwise into one sorted, duplicate-free list
+// and appends it to pairs. The result only depends on which pairs were found, not on which thread
+// found them.
+
+static void mergePairs(PairBuffers &buffers, vector<Pair> &pairs, ThreadPool *pool) {
+	size_t count = buffers.found.size();
+	vector<Pair *> sorted(count);
+	vector<size_t> sizes(count);
+	ThreadPool::forRange(pool, count, 1, [&buffers, &sorted, &sizes](size_t begin, size_t end, int slot) {
+		for (size_t i = begin; i < end; i ++) {
+			sizes[i] = buffers.found[i].size();
+			sorted[i] = buffers.arenas.get(slot).allocate<Pair>(sizes[i]);
+			buffers.found[i].copyTo(sorted[i]);
+			sort(sorted[i], sorted[i] + sizes[i]);
+		}
+	});
+
+	Arena &arena = buffers.arenas.get(0);
+	for (size_t step = 1; step < count; step *= 2) {
+		for (size_t i = 0; i + step < count; i += step * 2) {
+			Pair *merged = arena.allocate<Pair>(sizes[i] + sizes[i + step]);
+			merge(sorted[i], sorted[i] + sizes[i], sorted[i + step], sorted[i + step] + sizes[i + step], merged);
+			sorted[i] = merged;
+			sizes[i] += sizes[i + step];
+		}
+	}
+
+	Pair *all = sorted[0];
+	pairs.insert(pairs.end(), all, unique(all, all + sizes[0]));
+}
+
+// Tests every box against every earlier box. This is what getCollisions has always done. Rows get
+// longer as they go, so they are handed out in small chunks to keep the threads even. All of the
+// strategies do their actual testing through an AABBStore, several boxes at a time.
+
+void findOverlapsBruteForce(vector<AABB> &AABBs, vector<pair<int, int> > &pairs, ThreadPool *pool) {
+	AABBStore store(AABBs);
+	PairBuffers buffers(ThreadPool::getSlotCount(pool));
+	ThreadPool::forRange(pool, AABBs.size(), 64, [&store, &buffers](size_t begin, size_t end, int slot) {
+		ArenaList<Pair> &found = buffers.found[slot];
+		for (size_t i = begin; i < end; i ++) {
+			store.forEachIntersecting(i, 0, i, [&found, i](size_t j) {
+				found.push_back(make_pair((int)i, (int)j));
+			});
+		}
+	});
+	mergePairs(buffers, pairs, pool);
+}
+
+// Sort-and-sweep along the longest axis of the map. Boxes are sorted by their minimum on that
+// axis, and each box only has to be tested against the boxes that start before it ends. Needs
+// every box to be regular, since NaNs can't be sorted.
+
+struct SweepEntry {
+	double min;
+	double max;
+	int index;
+	bool operator<(const SweepEntry &other) const {
+		if (this->min != other.min)
+			return this->min < other.min;
+		return this->index < other.index;
+	}
+};
+
+void findOverlapsSweep(vector<AABB> &AABBs, vector<pair<int, int> > &pairs, ThreadPool *pool) {
+	for (size_t i = 0; i < AABBs.size(); i ++) {
+		if (!isRegular(AABBs[i])) {
+			findOverlapsBruteForce(AABBs, pairs, pool);
+			return;
+		}
+	}
+
+	double lo[3], hi[3], avg[3];
+	getSceneBounds(AABBs, lo, hi, avg);
+	int axis = 0;
+	for (int i = 1; i < 3; i ++) {
+		if (hi[i] - lo[i] > hi[axis] - lo[axis])
+			axis = i;
+	}
+
+	vector<SweepEntry> entries(AABBs.size());
+	for (size_t i = 0; i < AABBs.size(); i ++) {
+		entries[i].min = AABBs[i].getMin(axis);
+		entries[i].max = AABBs[i].getMax(axis);
+		entries[i].index = (int)i;
+	}
+	sort(entries.begin(), entries.end());
+
+	// The store holds the boxes in sweep order, so the boxes that start before a box ends are one
+	// contiguous range of it.
+	vector<int> order(entries.size());
+	for (size_t i = 0; i < entries.size(); i ++)
+		order[i] = entries[i].index;
+	AABBStore store;
+	store.assign(AABBs, order.data(), order.size());
+
+	PairBuffers buffers(ThreadPool::getSlotCount(pool));
+	ThreadPool::forRange(pool, entries.size(), 256, [&store, &entries, &order, axis, &buffers](size_t begin, size_t end, int slot) {
+		ArenaList<Pair> &found = buffers.found[slot];
+		for (size_t a = begin; a < end; a ++) {
+			size_t stop = store.upperBoundMin(axis, a + 1, entries.size(), entries[a].max);
+			int ia = order[a];
+			store.forEachIntersecting(a, a + 1, stop, [&found, &order, ia](size_t b) {
+				int ib = order[b];
+				found.push_back(make_pair(max(ia, ib), min(ia, ib)));
+			});
+		}
+	});
+	mergePairs(buffers, pairs, pool);
+}
+
+// Uniform grid. Every box is dropped into each cell it touches, and boxes sharing a cell are
+// tested against each other. A pair can share many cells, so it is only reported from the cell
+// holding the low corner of the overlap; that cell is always covered by both boxes. Boxes that
+// are too big for the grid (or aren't regular) are tested against everything.
+
+struct GridCells {
+	double origin[3];
+	double scale;
+
+	int64_t getCell(int axis, double value) {
+		int64_t cell = (int64_t)floor((value - this->origin[axis]) * this->scale);
+		if (cell < 0)
+			return 0;
+		if (cell >= (1 << GRID_AXIS_BITS))
+			return (1 << GRID_AXIS_BITS) - 1;
+		return cell;
+	}
+
+	uint64_t getKey(int64_t x, int64_t y, int64_t z) {
+		return ((uint64_t)x << (2 * GRID_AXIS_BITS)) | ((uint64_t)y << GRID_AXIS_BITS) | (uint64_t)z;
+	}
+};
+
+void findOverlapsGrid(vector<AABB> &AABBs, vector<pair<int, int> > &pairs, ThreadPool *pool) {
+	double lo[3], hi[3], avg[3];
+	getSceneBounds(AABBs, lo, hi, avg);
+
+	// Cells are cubes about the size of an average box, but never so small that the map would
+	// need more cells than fit in a key.
+	double size = (avg[0] + avg[1] + avg[2]) / 3.0;
+	for (int axis = 0; axis < 3; axis ++) {
+		if (hi[axis] > lo[axis])
+			size = max(size, (hi[axis] - lo[axis]) / GRID_AXIS_CELLS);
+	}
+	if (!(size > 0))
+		size = 1.0;
+
+	GridCells grid;
+	for (int axis = 0; axis < 3; axis ++)
+		grid.origin[axis] = (lo[axis] <= hi[axis] ? lo[axis] : 0);
+	grid.scale = 1.0 / size;
+
+	// The cell entries are scratch too, and there's no telling how many there'll be
+	PairBuffers buffers(ThreadPool::getSlotCount(pool));
+	ArenaList<pair<uint64_t, int> > cellEntries(&buffers.arenas.get(0));
+	vector<int> oversized;
+	vector<bool> isOversized(AABBs.size(), false);
+
+	for (size_t i = 0; i < AABBs.size(); i ++) {
+		AABB &box = AABBs[i];
+		int64_t c0[3], c1[3];
+		int64_t cells = 1;
+		if (isRegular(box)) {
+			for (int axis = 0; axis < 3; axis ++) {
+				c0[axis] = grid.getCell(axis, box.getMin(axis));
+				c1[axis] = grid.getCell(axis, box.getMax(axis));
+				cells *= (c1[axis] - c0[axis] + 1);
+			}
+		}
+		if (!isRegular(box) || cells > GRID_MAX_CELLS) {
+			oversized.push_back((int)i);
+			isOversized[i] = true;
+			continue;
+		}
+		for (int64_t x = c0[0]; x <= c1[0]; x ++)
+			for (int64_t y = c0[1]; y <= c1[1]; y ++)
+				for (int64_t z = c0[2]; z <= c1[2]; z ++)
+					cellEntries.push_back(make_pair(grid.getKey(x, y, z), (int)i));
+	}
+	size_t entryCount = cellEntries.size();
+	pair<uint64_t, int> *entries = buffers.arenas.get(0).allocate<pair<uint64_t, int> >(entryCount);
+	cellEntries.copyTo(entries);
+	sort(entries, entries + entryCount);
+
+	// Find where each cell's run of boxes starts so the runs can be handed out.
+	vector<size_t> runs;
+	for (size_t i = 0; i < entryCount; i ++) {
+		if (i == 0 || entries[i].first != entries[i - 1].first)
+			runs.push_back(i);
+	}
+	runs.push_back(entryCount);
+
+	// One copy of each box per cell it is in, in cell order, so every run is contiguous.
+	vector<int> order(entryCount);
+	for (size_t i = 0; i < entryCount; i ++)
+		order[i] = entries[i].second;
+	AABBStore cellStore;
+	cellStore.assign(AABBs, order.data(), order.size());
+
+	ThreadPool::forRange(pool, runs.size() - 1, 256, [&cellStore, &order, entries, &runs, &buffers, &grid](size_t begin, size_t end, int slot) {
+		ArenaList<Pair> &found = buffers.found[slot];
+		for (size_t run = begin; run < end; run ++) {
+			uint64_t key = entries[runs[run]].first;
+			for (size_t a = runs[run]; a < runs[run + 1]; a ++) {
+				int ia = order[a];
+				cellStore.forEachIntersecting(a, a + 1, runs[run + 1], [&cellStore, &order, &found, &grid, key, a, ia](size_t b) {
+					int ib = order[b];
+					int64_t corner[3];
+					for (int axis = 0; axis < 3; axis ++)
+						corner[axis] = grid.getCell(axis, max(cellStore.getMin(a, axis), cellStore.getMin(b, axis)));
+					if (grid.getKey(corner[0], corner[1], corner[2]) == key)
+						found.push_back(make_pair(max(ia, ib), min(ia, ib)));
+				});
+			}
+		}
+	});
+
+	// Finally the leftovers. Pairs of two oversized boxes are only tested once, from the later one.
+	AABBStore store(AABBs);
+	ThreadPool::forRange(pool, oversized.size(), 1, [&store, &oversized, &isOversized, &buffers](size_t begin, size_t end, int slot) {
+		ArenaList<Pair> &found = buffers.found[slot];
+		for (size_t i = begin; i < end; i ++) {
+			int io = oversized[i];
+			store.forEachIntersecting(io, 0, store.size(), [&found, &isOversized, io](size_t b) {
+				int j = (int)b;
+				if (j == io || (isOversized[j] && j > io))
+					return;
+				found.push_back(make_pair(max(io, j), min(io, j)));
+			});
+		}
+	});
+	mergePairs(buffers, pairs, pool);
+}
+
+// Small maps are brute forced. Otherwise we estimate how many boxes the sweep would see per box
+// (the boxes are spread along the longest axis, each covering its average size of it) and fall
+// back on the grid when the map is too crowded along that axis.
+
+BroadPhase chooseBroadPhase(vector<AABB> &AABBs) {
+	if (AABBs.size() < BROADPHASE_MIN_BOXES)
+		return BroadPhaseBruteForce;
+
+	double lo[3], hi[3], avg[3];
+	int count = getSceneBounds(AABBs, lo, hi, avg);
+	if (count < (int)AABBs.size())
+		return BroadPhaseGrid; // Only the grid copes with broken boxes without brute forcing.
+
+	int axis = 0;
+	for (int i = 1; i < 3; i ++) {
+		if (hi[i] - lo[i] > hi[axis] - lo[axis])
+			axis = i;
+	}
+	double extent = hi[axis] - lo[axis];
+	if (!(extent > 0))
+		return BroadPhaseBruteForce; // Everything overlaps along every axis anyway.
+
+	double candidates = count * (avg[axis] / extent);
+	if (candidates > SWEEP_MAX_CANDIDATES)
+		return BroadPhaseGrid;
+	return BroadPhaseSweep;
+}
+
+void findOverlaps(vector<AABB> &AABBs, BroadPhase method, vector<pair<int, int> > &pairs, ThreadPool *pool) {
+	if (method == BroadPhaseAuto)
+		method = chooseBroadPhase(AABBs);
+
+	switch (method) {
+		case BroadPhaseSweep:
+			findOverlapsSweep(AABBs, pairs, pool);
+			break;
+		case BroadPhaseGrid:
+			findOverlapsGrid(AABBs, pairs, pool);
+			break;
+		default:
+			findOverlapsBruteForce(AABBs, pairs, pool);
+			break;
+	}
+}
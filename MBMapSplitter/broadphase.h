@@ -0,0 +1,51 @@
+//
+//  broadphase.h
+//  MBMapSplitter
+//
+//  Copyright (c) 2015 HiGuy Smith
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#ifndef __MBMapSplitter__broadphase__
+#define __MBMapSplitter__broadphase__
+
+#include <utility>
+#include <vector>
+#include "aabbcolor.h"
+#include "threadpool.h"
+
+// Broad-phase collision detection. Each of these finds every intersecting pair (i, j) with j < i,
+// where i and j are indices into AABBs, and appends them to pairs sorted by (i, j); the same order
+// the brute-force loop produces them in. Given a pool, the testing is split across its threads,
+// each collecting pairs in its own buffer, and the buffers are sorted and merged at the end. The
+// pairs come out the same no matter how many threads there are.
+
+void findOverlapsBruteForce(vector<AABB> &AABBs, vector<pair<int, int> > &pairs, ThreadPool *pool = NULL);
+void findOverlapsSweep(vector<AABB> &AABBs, vector<pair<int, int> > &pairs, ThreadPool *pool = NULL);
+void findOverlapsGrid(vector<AABB> &AABBs, vector<pair<int, int> > &pairs, ThreadPool *pool = NULL);
+
+// Picks a strategy for the given boxes based on how many there are and how they are spread out.
+
+BroadPhase chooseBroadPhase(vector<AABB> &AABBs);
+
+// Finds every intersecting pair using the given strategy.
+
+void findOverlaps(vector<AABB> &AABBs, BroadPhase method, vector<pair<int, int> > &pairs, ThreadPool *pool = NULL);
+
+#endif
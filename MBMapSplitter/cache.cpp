@@ -0,0 +1,322 @@
+//
+//  cache.cpp
+//  MBMapSplitter
+//
+//  Copyright (c) 2015 HiGuy Smith
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#include "cache.h"
+#include "aabbstore.h"
+#include "broadphase.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+
+#define CACHE_MAGIC "MBSCACHE"
+//Written in the machine's own byte order, so a cache from a machine that disagrees won't match
+#define CACHE_BYTE_ORDER 0x01020304
+//Bytes per brush and per edge after the header
+#define CACHE_BRUSH_SIZE (sizeof(uint64_t) + 6 * sizeof(double) + sizeof(int32_t))
+#define CACHE_EDGE_SIZE (2 * sizeof(int32_t))
+
+uint64_t hashBytes(const char *data, size_t length, uint64_t hash) {
+	for (size_t i = 0; i < length; i ++) {
+		hash ^= (unsigned char)data[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+void hashBrushes(const char *data, const std::vector<MapSpan> &brushes, std::vector<uint64_t> &hashes, ThreadPool &pool) {
+	hashes.assign(brushes.size(), 0);
+	pool.parallelFor(brushes.size(), 1024, [data, &brushes, &hashes](size_t begin, size_t end, int) {
+		for (size_t i = begin; i < end; i ++) {
+			hashes[i] = hashBytes(data + brushes[i].offset, brushes[i].length);
+		}
+	});
+}
+
+uint64_t getMapHash(const char *data, const std::vector<MapSpan> &header, const std::vector<uint64_t> &brushHashes) {
+	uint64_t hash = hashBytes(NULL, 0);
+	for (size_t i = 0; i < header.size(); i ++) {
+		hash = hashBytes(data + header[i].offset, header[i].length, hash);
+	}
+	if (!brushHashes.empty()) {
+		hash = hashBytes((const char *)brushHashes.data(), brushHashes.size() * sizeof(uint64_t), hash);
+	}
+	return hash;
+}
+
+MapCache::MapCache() : header(NULL), brushHashes(NULL), AABBs(NULL), edges(NULL), colors(NULL) {
+
+}
+
+bool MapCache::open(const char *path) {
+	close();
+	if (!file.open(path, true) || !validate()) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+void MapCache::close() {
+	file.close();
+	header = NULL;
+	brushHashes = NULL;
+	AABBs = NULL;
+	edges = NULL;
+	colors = NULL;
+}
+
+//Checks everything we're going to rely on: that it's our format and version, that the counts
+//agree with the file size, that the checksum matches, and that every edge and color is in range
+bool MapCache::validate() {
+	const char *data = file.getData();
+	size_t length = file.getLength();
+	if (length < sizeof(CacheHeader)) {
+		return false;
+	}
+	const CacheHeader *check = (const CacheHeader *)data;
+	if (memcmp(check->magic, CACHE_MAGIC, sizeof(check->magic)) != 0 || check->version != CACHE_VERSION || check->byteOrder != CACHE_BYTE_ORDER) {
+		return false;
+	}
+
+	//Divide rather than multiply so a garbage count can't overflow its way into looking right
+	uint64_t room = length - sizeof(CacheHeader);
+	if (check->brushCount > room / CACHE_BRUSH_SIZE || check->brushCount > INT_MAX || check->edgeCount > room / CACHE_EDGE_SIZE) {
+		return false;
+	}
+	if (check->brushCount * CACHE_BRUSH_SIZE + check->edgeCount * CACHE_EDGE_SIZE != room) {
+		return false;
+	}
+	if (hashBytes(data + sizeof(CacheHeader), (size_t)room) != check->checksum) {
+		return false;
+	}
+
+	size_t brushCount = (size_t)check->brushCount;
+	size_t edgeCount = (size_t)check->edgeCount;
+	const char *pos = data + sizeof(CacheHeader);
+	const uint64_t *checkHashes = (const uint64_t *)pos;
+	pos += brushCount * sizeof(uint64_t);
+	const double *checkAABBs = (const double *)pos;
+	pos += brushCount * 6 * sizeof(double);
+	const int32_t *checkEdges = (const int32_t *)pos;
+	pos += edgeCount * CACHE_EDGE_SIZE;
+	const int32_t *checkColors = (const int32_t *)pos;
+
+	for (size_t i = 0; i < edgeCount; i ++) {
+		int32_t first = checkEdges[i * 2];
+		int32_t second = checkEdges[i * 2 + 1];
+		if (second < 0 || second >= first || first >= (int32_t)brushCount) {
+			return false;
+		}
+		//Sorted with no repeats
+		if (i > 0 && std::make_pair(checkEdges[i * 2 - 2], checkEdges[i * 2 - 1]) >= std::make_pair(first, second)) {
+			return false;
+		}
+	}
+	for (size_t i = 0; i < brushCount; i ++) {
+		if (checkColors[i] < 0 || checkColors[i] >= (int32_t)brushCount) {
+			return false;
+		}
+	}
+
+	header = check;
+	brushHashes = checkHashes;
+	AABBs = checkAABBs;
+	edges = checkEdges;
+	colors = checkColors;
+	return true;
+}
+
+AABB MapCache::getAABB(size_t brush) const {
+	const double *box = AABBs + brush * 6;
+	return AABB(box[0], box[1], box[2], box[3], box[4], box[5]);
+}
+
+bool MapCache::hasEdges(const std::vector<std::pair<int, int> > &pairs) const {
+	if (pairs.size() != getEdgeCount()) {
+		return false;
+	}
+	for (size_t i = 0; i < pairs.size(); i ++) {
+		if (pairs[i] != getEdge(i)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+size_t getCachedCollisions(const MapCache &cache, const char *data, const std::vector<MapSpan> &brushes, const std::vector<uint64_t> &hashes, BroadPhase method, std::vector<AABB> &AABBs, std::vector<std::pair<int, int> > &edges, ThreadPool &pool) {
+	size_t count = brushes.size();
+	size_t cachedCount = (cache.isValid() ? cache.getBrushCount() : 0);
+
+	//Match brushes up with cached ones by hash. Identical brushes are matched up in order.
+	std::vector<int> cachedAs(count, -1);
+	std::vector<int> newIndex(cachedCount, -1);
+	if (cachedCount > 0) {
+		std::vector<std::pair<uint64_t, int> > byHash(cachedCount);
+		for (size_t i = 0; i < cachedCount; i ++) {
+			byHash[i] = std::make_pair(cache.getBrushHashes()[i], (int)i);
+		}
+		std::sort(byHash.begin(), byHash.end());
+
+		std::unordered_map<uint64_t, size_t> taken;
+		for (size_t i = 0; i < count; i ++) {
+			size_t first = std::lower_bound(byHash.begin(), byHash.end(), std::make_pair(hashes[i], INT_MIN)) - byHash.begin();
+			size_t next = first + taken[hashes[i]];
+			if (next < byHash.size() && byHash[next].first == hashes[i]) {
+				cachedAs[i] = byHash[next].second;
+				newIndex[byHash[next].second] = (int)i;
+				taken[hashes[i]] ++;
+			}
+		}
+	}
+
+	//Only the brushes we don't know get parsed
+	AABBs.assign(count, AABB(0, 0, 0, 0, 0, 0));
+	pool.parallelFor(count, 1024, [&cache, data, &brushes, &cachedAs, &AABBs](size_t begin, size_t end, int) {
+		for (size_t i = begin; i < end; i ++) {
+			if (cachedAs[i] >= 0) {
+				AABBs[i] = cache.getAABB(cachedAs[i]);
+			} else {
+				AABBs[i] = getBrushAABB(data + brushes[i].offset, brushes[i].length);
+			}
+		}
+	});
+
+	std::vector<int> changed;
+	std::vector<char> isChanged(count, 0);
+	for (size_t i = 0; i < count; i ++) {
+		if (cachedAs[i] < 0) {
+			changed.push_back((int)i);
+			isChanged[i] = 1;
+		}
+	}
+
+	//Testing a changed brush means testing it against everything, so past a point it's cheaper to
+	//just do the whole map
+	edges.clear();
+	if (cachedCount == 0 || changed.size() > 64 + count / 64) {
+		findOverlaps(AABBs, method, edges, &pool);
+		return changed.size();
+	}
+
+	//Two brushes that haven't changed still collide (or don't) just like they did
+	for (size_t i = 0; i < cache.getEdgeCount(); i ++) {
+		std::pair<int, int> edge = cache.getEdge(i);
+		int first = newIndex[edge.first];
+		int second = newIndex[edge.second];
+		if (first >= 0 && second >= 0) {
+			edges.push_back(std::make_pair(std::max(first, second), std::min(first, second)));
+		}
+	}
+
+	//Everything else involves a changed brush. A pair of changed brushes is tested from the later one.
+	AABBStore store(AABBs);
+	std::vector<std::vector<std::pair<int, int> > > buffers(pool.getThreadCount());
+	pool.parallelFor(changed.size(), 1, [&store, &changed, &isChanged, &buffers](size_t begin, size_t end, int slot) {
+		std::vector<std::pair<int, int> > &found = buffers[slot];
+		for (size_t i = begin; i < end; i ++) {
+			int brush = changed[i];
+			store.forEachIntersecting(brush, 0, store.size(), [&found, &isChanged, brush](size_t other) {
+				int j = (int)other;
+				if (j == brush || (isChanged[j] && j > brush)) {
+					return;
+				}
+				found.push_back(std::make_pair(std::max(brush, j), std::min(brush, j)));
+			});
+		}
+	});
+	for (size_t i = 0; i < buffers.size(); i ++) {
+		edges.insert(edges.end(), buffers[i].begin(), buffers[i].end());
+	}
+	std::sort(edges.begin(), edges.end());
+
+	return changed.size();
+}
+
+bool writeMapCache(const char *path, uint64_t mapHash, const std::vector<uint64_t> &hashes, std::vector<AABB> &AABBs, const std::vector<std::pair<int, int> > &edges, const std::vector<int> &colors, uint64_t coloringKey) {
+	size_t brushCount = hashes.size();
+	std::string buffer(sizeof(CacheHeader) + brushCount * CACHE_BRUSH_SIZE + edges.size() * CACHE_EDGE_SIZE, '\0');
+
+	char *pos = &buffer[sizeof(CacheHeader)];
+	memcpy(pos, hashes.data(), brushCount * sizeof(uint64_t));
+	pos += brushCount * sizeof(uint64_t);
+	for (size_t i = 0; i < brushCount; i ++) {
+		double box[6];
+		for (int axis = 0; axis < 3; axis ++) {
+			box[axis] = AABBs[i].getMin(axis);
+			box[axis + 3] = AABBs[i].getMax(axis);
+		}
+		memcpy(pos, box, sizeof(box));
+		pos += sizeof(box);
+	}
+	for (size_t i = 0; i < edges.size(); i ++) {
+		int32_t edge[2] = {edges[i].first, edges[i].second};
+		memcpy(pos, edge, sizeof(edge));
+		pos += sizeof(edge);
+	}
+	for (size_t i = 0; i < brushCount; i ++) {
+		int32_t color = colors[i];
+		memcpy(pos, &color, sizeof(color));
+		pos += sizeof(color);
+	}
+
+	CacheHeader header;
+	memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+	header.version = CACHE_VERSION;
+	header.byteOrder = CACHE_BYTE_ORDER;
+	header.mapHash = mapHash;
+	header.brushCount = brushCount;
+	header.edgeCount = edges.size();
+	header.coloringKey = coloringKey;
+	header.checksum = hashBytes(buffer.data() + sizeof(CacheHeader), buffer.size() - sizeof(CacheHeader));
+	memcpy(&buffer[0], &header, sizeof(header));
+
+	std::string temp(path);
+	temp += ".tmp";
+	std::ofstream output;
+	output.open(temp.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!output.is_open()) {
+		return false;
+	}
+	output.write(buffer.data(), buffer.size());
+	output.close();
+	if (output.fail()) {
+		remove(temp.c_str());
+		return false;
+	}
+
+#ifdef _WIN32
+	//rename won't replace a file here
+	remove(path);
+#endif
+	if (rename(temp.c_str(), path) != 0) {
+		remove(temp.c_str());
+		return false;
+	}
+	return true;
+}
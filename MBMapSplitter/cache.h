@@ -0,0 +1,117 @@
+//
+//  cache.h
+//  MBMapSplitter
+//
+//  Copyright (c) 2015 HiGuy Smith
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#ifndef __MBMapSplitter__cache__
+#define __MBMapSplitter__cache__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+#include "aabbcolor.h"
+#include "mapfile.h"
+#include "threadpool.h"
+
+//What a run worked out about a map, saved next to it so the next run doesn't have to do it all
+//again: a hash of every brush's text, every brush's AABB, the collision edges and the coloring.
+//The file is laid out so it can be mapped straight into memory and used where it lies:
+//
+//  CacheHeader
+//  uint64_t brushHashes[brushCount]
+//  double   AABBs[brushCount][6]      (x1 y1 z1 x2 y2 z2)
+//  int32_t  edges[edgeCount][2]       (i, j) with j < i, sorted
+//  int32_t  colors[brushCount]
+//
+//Nothing in it is trusted until it has been checked over, and a cache that fails any check is
+//just ignored, so the worst a bad cache can do is make a run take as long as it would have anyway.
+
+//Bump this whenever parsing, collision or coloring would give different answers than before, so
+//old caches get thrown out rather than reused
+#define CACHE_VERSION 3
+
+struct CacheHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t byteOrder;
+	uint64_t mapHash;
+	uint64_t brushCount;
+	uint64_t edgeCount;
+	//Which settings the colors were made with (see getColoringKey), since the same edges can be
+	//colored more than one way
+	uint64_t coloringKey;
+	uint64_t checksum;
+};
+
+//64-bit FNV-1a
+uint64_t hashBytes(const char *data, size_t length, uint64_t hash = 14695981039346656037ULL);
+
+//Hashes every brush's text, spread over the pool
+void hashBrushes(const char *data, const std::vector<MapSpan> &brushes, std::vector<uint64_t> &hashes, ThreadPool &pool);
+
+//A hash of everything that ends up in the split maps: the header text and the brushes, in order
+uint64_t getMapHash(const char *data, const std::vector<MapSpan> &header, const std::vector<uint64_t> &brushHashes);
+
+class MapCache {
+	MapFile file;
+	const CacheHeader *header;
+	const uint64_t *brushHashes;
+	const double *AABBs;
+	const int32_t *edges;
+	const int32_t *colors;
+
+	bool validate();
+public:
+	MapCache();
+
+	//Returns false (and holds nothing) if there's no cache or it can't be trusted
+	bool open(const char *path);
+	void close();
+	bool isValid() const { return header != NULL; }
+
+	uint64_t getMapHash() const { return header->mapHash; }
+	size_t getBrushCount() const { return (size_t)header->brushCount; }
+	size_t getEdgeCount() const { return (size_t)header->edgeCount; }
+	uint64_t getColoringKey() const { return header->coloringKey; }
+	const uint64_t *getBrushHashes() const { return brushHashes; }
+	AABB getAABB(size_t brush) const;
+	std::pair<int, int> getEdge(size_t edge) const { return std::make_pair((int)edges[edge * 2], (int)edges[edge * 2 + 1]); }
+	const int32_t *getColors() const { return colors; }
+
+	//Whether the cached edges are exactly these
+	bool hasEdges(const std::vector<std::pair<int, int> > &pairs) const;
+};
+
+//Finds every brush's AABB and every collision, taking what it can from the cache. A brush whose
+//text is in the cache keeps its cached AABB, and two such brushes keep their cached edge (or lack
+//of one). Only the brushes that are new or changed get parsed and tested against the rest. If
+//too much has changed for that to pay off, the collisions are found from scratch instead. The
+//results are always exactly what a run without a cache would get. Returns how many brushes had to
+//be parsed.
+size_t getCachedCollisions(const MapCache &cache, const char *data, const std::vector<MapSpan> &brushes, const std::vector<uint64_t> &hashes, BroadPhase method, std::vector<AABB> &AABBs, std::vector<std::pair<int, int> > &edges, ThreadPool &pool);
+
+//Saves a run's results. The file is written next to path and moved into place once it's complete,
+//so a run that dies halfway never leaves a broken cache behind.
+bool writeMapCache(const char *path, uint64_t mapHash, const std::vector<uint64_t> &hashes, std::vector<AABB> &AABBs, const std::vector<std::pair<int, int> > &edges, const std::vector<int> &colors, uint64_t coloringKey);
+
+#endif
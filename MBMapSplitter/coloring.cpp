@@ -0,0 +1,1089 @@
+//
+//  coloring.cpp
+//  MBMapSplitter
+//
+//  Copyright (c) 2015 HiGuy Smith
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <vector>
+#include <stdint.h>
+#include "coloring.h"
+#include "threadpool.h"
+
+using namespace std;
+
+// Returns the index of the lowest set bit. bits must not be zero.
+
+static int lowestBit(uint64_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_ctzll(bits);
+#else
+	int bit = 0;
+	while (!(bits & 1)) {
+		bits >>= 1;
+		bit ++;
+	}
+	return bit;
+#endif
+}
+
+// The colors used by each node's neighbors, one bit per color. The first 64 colors live in a
+// single word per node, which is all most maps ever need. The rest are only allocated once a
+// node actually sees a color past 63.
+
+class NeighborColors {
+private:
+	vector<uint64_t> low;
+	vector<vector<uint64_t> > high;
+public:
+	NeighborColors(int nodeCount) : low(nodeCount, 0) {}
+
+	// Marks color as used next to node. Returns whether it wasn't already.
+	bool add(int node, int color) {
+		if (color < 64) {
+			uint64_t bit = (uint64_t)1 << color;
+			if (this->low[node] & bit)
+				return false;
+			this->low[node] |= bit;
+			return true;
+		}
+		if (this->high.empty())
+			this->high.resize(this->low.size());
+		vector<uint64_t> &words = this->high[node];
+		size_t word = (color - 64) / 64;
+		uint64_t bit = (uint64_t)1 << ((color - 64) % 64);
+		if (words.size() <= word)
+			words.resize(word + 1, 0);
+		if (words[word] & bit)
+			return false;
+		words[word] |= bit;
+		return true;
+	}
+
+	// Returns whether color is used next to node.
+	bool has(int node, int color) const {
+		if (color < 64)
+			return (this->low[node] >> color) & 1;
+		if (this->high.empty())
+			return false;
+		const vector<uint64_t> &words = this->high[node];
+		size_t word = (color - 64) / 64;
+		return word < words.size() && ((words[word] >> ((color - 64) % 64)) & 1);
+	}
+
+	// Returns the smallest color not used next to node.
+	int firstFree(int node) {
+		if (~this->low[node])
+			return lowestBit(~this->low[node]);
+		if (this->high.empty())
+			return 64;
+		vector<uint64_t> &words = this->high[node];
+		for (size_t word = 0; word < words.size(); word ++) {
+			if (~words[word])
+				return 64 + (int)word * 64 + lowestBit(~words[word]);
+		}
+		return 64 + (int)words.size() * 64;
+	}
+};
+
+// DSATUR's node order, with choose picking each node's color: choose(node, used, colorCount) gets
+// the colors used next to every node and how many colors there are so far. The last ties go to
+// whichever node comes first in tieOrder, or the lowest position without one.
+
+template <class Choose>
+static int runDSATUR(int nodeCount, const size_t *offsets, const int *targets, int *colors, const int *tieOrder, Choose choose) {
+	// Ties on saturation go to the highest degree, then the lowest position. That order never
+	// changes, so rank every node by it once and let the queues compare ranks.
+	vector<int> nodeAt(nodeCount);
+	vector<int> rank(nodeCount);
+	for (int i = 0; i < nodeCount; i ++)
+		nodeAt[i] = (tieOrder != NULL ? tieOrder[i] : i);
+	vector<int> degree(nodeCount);
+	for (int i = 0; i < nodeCount; i ++)
+		degree[i] = (int)(offsets[i + 1] - offsets[i]);
+	stable_sort(nodeAt.begin(), nodeAt.end(), [&degree](int a, int b) {
+		return degree[a] > degree[b];
+	});
+	for (int i = 0; i < nodeCount; i ++)
+		rank[nodeAt[i]] = i;
+
+	// One queue of ranks per saturation. Saturation only ever goes up, so rather than moving a
+	// node between queues we push it again and skip the stale entry when it surfaces.
+	typedef priority_queue<int, vector<int>, greater<int> > RankQueue;
+	vector<RankQueue> buckets(1);
+	for (int i = 0; i < nodeCount; i ++)
+		buckets[0].push(i);
+
+	vector<int> saturation(nodeCount, 0);
+	NeighborColors used(nodeCount);
+	for (int i = 0; i < nodeCount; i ++)
+		colors[i] = -1;
+
+	int colorCount = 0;
+	int maxSaturation = 0;
+	for (int step = 0; step < nodeCount; step ++) {
+		// Find the uncolored node with the highest saturation.
+		int next = -1;
+		while (next == -1) {
+			RankQueue &bucket = buckets[maxSaturation];
+			while (!bucket.empty()) {
+				int node = nodeAt[bucket.top()];
+				if (colors[node] == -1 && saturation[node] == maxSaturation)
+					break;
+				bucket.pop();
+			}
+			if (bucket.empty()) {
+				maxSaturation --;
+				continue;
+			}
+			next = nodeAt[bucket.top()];
+			bucket.pop();
+		}
+
+		int color = choose(next, used, colorCount);
+		colors[next] = color;
+		if (color >= colorCount)
+			colorCount = color + 1;
+
+		// Only the uncolored neighbors can change saturation.
+		for (size_t edge = offsets[next]; edge < offsets[next + 1]; edge ++) {
+			int neighbor = targets[edge];
+			if (colors[neighbor] != -1 || !used.add(neighbor, color))
+				continue;
+			int newSaturation = ++ saturation[neighbor];
+			if (newSaturation >= (int)buckets.size())
+				buckets.resize(newSaturation + 1);
+			buckets[newSaturation].push(rank[neighbor]);
+			if (newSaturation > maxSaturation)
+				maxSaturation = newSaturation;
+		}
+	}
+
+	return colorCount;
+}
+
+int colorDSATUR(int nodeCount, const size_t *offsets, const int *targets, int *colors) {
+	return runDSATUR(nodeCount, offsets, targets, colors, NULL, [](int node, NeighborColors &used, int) {
+		return used.firstFree(node);
+	});
+}
+
+// Spreads a number's lowest 21 bits out to every third bit, for interleaving.
+
+static uint64_t spreadBits(uint64_t bits) {
+	bits &= 0x1FFFFF;
+	bits = (bits | bits << 32) & 0x1F00000000FFFFULL;
+	bits = (bits | bits << 16) & 0x1F0000FF0000FFULL;
+	bits = (bits | bits << 8) & 0x100F00F00F00F00FULL;
+	bits = (bits | bits << 4) & 0x10C30C30C30C30C3ULL;
+	bits = (bits | bits << 2) & 0x1249249249249249ULL;
+	return bits;
+}
+
+void getMortonOrder(int count, const double *bounds, int *order) {
+	if (count == 0)
+		return;
+	double low[3], high[3];
+	for (int axis = 0; axis < 3; axis ++) {
+		low[axis] = bounds[axis];
+		high[axis] = bounds[axis + 3];
+	}
+	for (int i = 1; i < count; i ++) {
+		for (int axis = 0; axis < 3; axis ++) {
+			low[axis] = min(low[axis], bounds[i * 6 + axis]);
+			high[axis] = max(high[axis], bounds[i * 6 + axis + 3]);
+		}
+	}
+
+	vector<pair<uint64_t, int> > codes(count);
+	for (int i = 0; i < count; i ++) {
+		uint64_t code = 0;
+		for (int axis = 0; axis < 3; axis ++) {
+			double center = (bounds[i * 6 + axis] + bounds[i * 6 + axis + 3]) / 2;
+			double size = high[axis] - low[axis];
+			uint64_t cell = (size > 0 ? (uint64_t)((center - low[axis]) / size * 0x1FFFFF) : 0);
+			code |= spreadBits(cell) << axis;
+		}
+		codes[i] = make_pair(code, i);
+	}
+	sort(codes.begin(), codes.end());
+	for (int i = 0; i < count; i ++)
+		order[i] = codes[i].second;
+}
+
+// A color class's bounds, grown one node at a time.
+
+class ClassBounds {
+private:
+	double box[6];
+public:
+	ClassBounds(const double *first) {
+		copy(first, first + 6, this->box);
+	}
+
+	// How much volume adding other would cost, and how much the sides would grow, for when the
+	// volume can't tell the difference (flat brushes have none).
+	void getGrowth(const double *other, double &volume, double &extent) const {
+		double before = 1, after = 1;
+		extent = 0;
+		for (int axis = 0; axis < 3; axis ++) {
+			double size = this->box[axis + 3] - this->box[axis];
+			double grown = max(this->box[axis + 3], other[axis + 3]) - min(this->box[axis], other[axis]);
+			before *= size;
+			after *= grown;
+			extent += grown - size;
+		}
+		volume = after - before;
+	}
+
+	void add(const double *other) {
+		for (int axis = 0; axis < 3; axis ++) {
+			this->box[axis] = min(this->box[axis], other[axis]);
+			this->box[axis + 3] = max(this->box[axis + 3], other[axis + 3]);
+		}
+	}
+};
+
+int colorDSATURLocal(int nodeCount, const size_t *offsets, const int *targets, const double *bounds, const int *regions, int *colors) {
+	vector<ClassBounds> classes;
+	// The colors each region has, so a node only ever looks through its own region's.
+	vector<vector<int> > regionColors(1);
+	if (regions != NULL) {
+		int regionCount = 0;
+		for (int i = 0; i < nodeCount; i ++)
+			regionCount = max(regionCount, regions[i] + 1);
+		regionColors.resize(max(regionCount, 1));
+	}
+
+	// Nodes that tie all the way are taken in Morton order, so the ones that could go anywhere
+	// come along in a sweep across the level rather than jumping around it.
+	vector<int> tieOrder(nodeCount);
+	if (nodeCount > 0)
+		getMortonOrder(nodeCount, bounds, &tieOrder[0]);
+
+	return runDSATUR(nodeCount, offsets, targets, colors, &tieOrder[0], [&](int node, NeighborColors &used, int colorCount) {
+		const double *box = bounds + (size_t)node * 6;
+		vector<int> &candidates = regionColors[regions != NULL ? regions[node] : 0];
+		int best = -1;
+		double bestVolume = 0, bestExtent = 0;
+		for (size_t i = 0; i < candidates.size(); i ++) {
+			int color = candidates[i];
+			if (used.has(node, color))
+				continue;
+			double volume, extent;
+			classes[color].getGrowth(box, volume, extent);
+			if (best == -1 || volume < bestVolume || (volume == bestVolume && (extent < bestExtent || (extent == bestExtent && color < best)))) {
+				best = color;
+				bestVolume = volume;
+				bestExtent = extent;
+			}
+		}
+		if (best == -1) {
+			best = colorCount;
+			classes.push_back(ClassBounds(box));
+			candidates.push_back(best);
+		} else {
+			classes[best].add(box);
+		}
+		return best;
+	});
+}
+
+// Finds the root of a node's set, halving the path on the way up.
+
+static int findRoot(vector<int> &parent, int node) {
+	while (parent[node] != node) {
+		parent[node] = parent[parent[node]];
+		node = parent[node];
+	}
+	return node;
+}
+
+int colorComponents(int nodeCount, const size_t *offsets, const int *targets, int *colors, ThreadPool *pool) {
+	if (nodeCount == 0)
+		return 0;
+
+	// Union-find, always keeping the lower node as the root so the components come out the same
+	// every time
+	vector<int> parent(nodeCount);
+	for (int i = 0; i < nodeCount; i ++)
+		parent[i] = i;
+	for (int i = 0; i < nodeCount; i ++) {
+		for (size_t edge = offsets[i]; edge < offsets[i + 1]; edge ++) {
+			int j = targets[edge];
+			if (j < i)
+				continue;
+			int a = findRoot(parent, i), b = findRoot(parent, j);
+			if (a != b)
+				parent[max(a, b)] = min(a, b);
+		}
+	}
+
+	// Number the components in order of their lowest node, and list each one's nodes in order
+	vector<int> component(nodeCount);
+	int componentCount = 0;
+	for (int i = 0; i < nodeCount; i ++) {
+		int root = findRoot(parent, i);
+		component[i] = (root == i ? componentCount ++ : component[root]);
+	}
+	vector<int> start(componentCount + 1, 0);
+	for (int i = 0; i < nodeCount; i ++)
+		start[component[i] + 1] ++;
+	for (int c = 0; c < componentCount; c ++)
+		start[c + 1] += start[c];
+	vector<int> members(nodeCount);
+	vector<int> local(nodeCount);
+	{
+		vector<int> next(start.begin(), start.end() - 1);
+		for (int i = 0; i < nodeCount; i ++) {
+			local[i] = next[component[i]] - start[component[i]];
+			members[next[component[i]] ++] = i;
+		}
+	}
+
+	// DSATUR on each one by itself. Nothing in one component changes the order or colors in
+	// another, so together these are exactly what DSATUR on the whole graph gives.
+	int slots = ThreadPool::getSlotCount(pool);
+	vector<vector<size_t> > localOffsets(slots);
+	vector<vector<int> > localTargets(slots);
+	vector<vector<int> > localColors(slots);
+	vector<int> componentColors(componentCount, 1);
+	ThreadPool::forRange(pool, componentCount, 64, [&](size_t begin, size_t end, int slot) {
+		for (size_t c = begin; c < end; c ++) {
+			int size = start[c + 1] - start[c];
+			const int *nodes = &members[start[c]];
+			// What DSATUR would do with these is plain, don't build anything for them
+			if (size <= 2) {
+				colors[nodes[0]] = 0;
+				if (size == 2) {
+					colors[nodes[1]] = 1;
+					componentColors[c] = 2;
+				}
+				continue;
+			}
+			vector<size_t> &subOffsets = localOffsets[slot];
+			vector<int> &subTargets = localTargets[slot];
+			vector<int> &subColors = localColors[slot];
+			subOffsets.assign(1, 0);
+			subTargets.clear();
+			for (int k = 0; k < size; k ++) {
+				int node = nodes[k];
+				// Local numbers keep the global order, so the neighbors stay sorted
+				for (size_t edge = offsets[node]; edge < offsets[node + 1]; edge ++)
+					subTargets.push_back(local[targets[edge]]);
+				subOffsets.push_back(subTargets.size());
+			}
+			subColors.resize(size);
+			componentColors[c] = colorDSATUR(size, &subOffsets[0], subTargets.empty() ? NULL : &subTargets[0], &subColors[0]);
+			for (int k = 0; k < size; k ++)
+				colors[nodes[k]] = subColors[k];
+		}
+	});
+
+	// Every component's colors can be swapped around freely, so pack them in: biggest components
+	// first, each one's biggest class going into the smallest class so far. Nothing needs more
+	// colors than the most any one component used.
+	int colorCount = 0;
+	for (int c = 0; c < componentCount; c ++)
+		colorCount = max(colorCount, componentColors[c]);
+	vector<int> order(componentCount);
+	for (int c = 0; c < componentCount; c ++)
+		order[c] = c;
+	stable_sort(order.begin(), order.end(), [&](int a, int b) {
+		return start[a + 1] - start[a] > start[b + 1] - start[b];
+	});
+	vector<long> classSize(colorCount, 0);
+	vector<int> byGlobal(colorCount), byLocal, localSize, remap;
+	for (int i = 0; i < componentCount; i ++) {
+		int c = order[i];
+		int count = componentColors[c];
+		if (count == 1) {
+			// Just one class (a lone node, from how they're sorted), so only the smallest matters
+			int smallest = (int)(min_element(classSize.begin(), classSize.end()) - classSize.begin());
+			for (int k = start[c]; k < start[c + 1]; k ++)
+				colors[members[k]] = smallest;
+			classSize[smallest] += start[c + 1] - start[c];
+			continue;
+		}
+		localSize.assign(count, 0);
+		for (int k = start[c]; k < start[c + 1]; k ++)
+			localSize[colors[members[k]]] ++;
+		byLocal.resize(count);
+		for (int color = 0; color < count; color ++)
+			byLocal[color] = color;
+		stable_sort(byLocal.begin(), byLocal.end(), [&](int a, int b) {
+			return localSize[a] > localSize[b];
+		});
+		for (int color = 0; color < colorCount; color ++)
+			byGlobal[color] = color;
+		stable_sort(byGlobal.begin(), byGlobal.end(), [&](int a, int b) {
+			return classSize[a] < classSize[b];
+		});
+		remap.resize(count);
+		for (int k = 0; k < count; k ++) {
+			remap[byLocal[k]] = byGlobal[k];
+			classSize[byGlobal[k]] += localSize[byLocal[k]];
+		}
+		for (int k = start[c]; k < start[c + 1]; k ++)
+			colors[members[k]] = remap[colors[members[k]]];
+	}
+	return colorCount;
+}
+
+// Mixes a seed and a node into a well spread out number (splitmix64's finalizer).
+
+static uint64_t mixNode(unsigned seed, int node) {
+	uint64_t bits = ((uint64_t)seed << 32) ^ (uint32_t)node;
+	bits += 0x9E3779B97F4A7C15ULL;
+	bits = (bits ^ (bits >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	bits = (bits ^ (bits >> 27)) * 0x94D049BB133111EBULL;
+	return bits ^ (bits >> 31);
+}
+
+int colorParallel(int nodeCount, const size_t *offsets, const int *targets, int *colors, ThreadPool *pool, unsigned seed) {
+	if (nodeCount == 0)
+		return 0;
+	int slots = ThreadPool::getSlotCount(pool);
+	const size_t chunkSize = 1024;
+
+	// Highest degree first, then a random order so that long chains of nodes waiting on each
+	// other are unlikely. The degree keeps the high 32 bits, the random number the low ones.
+	vector<uint64_t> priority(nodeCount);
+	int maxDegree = 0;
+	for (int i = 0; i < nodeCount; i ++) {
+		int degree = (int)(offsets[i + 1] - offsets[i]);
+		maxDegree = max(maxDegree, degree);
+		priority[i] = ((uint64_t)degree << 32) | (mixNode(seed, i) & 0xFFFFFFFF);
+	}
+	auto before = [&](int a, int b) {
+		return priority[a] > priority[b] || (priority[a] == priority[b] && a < b);
+	};
+
+	// How many neighbors each node is still waiting on. A node with none left is ready.
+	unique_ptr<atomic<int>[]> waiting(new atomic<int>[nodeCount]);
+	vector<vector<int> > found(slots);
+	ThreadPool::forRange(pool, nodeCount, chunkSize, [&](size_t begin, size_t end, int slot) {
+		for (size_t i = begin; i < end; i ++) {
+			int node = (int)i;
+			int count = 0;
+			for (size_t edge = offsets[node]; edge < offsets[node + 1]; edge ++)
+				count += before(targets[edge], node);
+			waiting[node].store(count, memory_order_relaxed);
+			if (count == 0)
+				found[slot].push_back(node);
+		}
+	});
+
+	// Every round colors the ready nodes at once. None of them are neighbors, and all they look
+	// at is the colors of neighbors from earlier rounds, so nobody reads a color being written.
+	vector<int> ready;
+	vector<vector<int> > used(slots, vector<int>(maxDegree + 2, -1));
+	for (;;) {
+		ready.clear();
+		for (int slot = 0; slot < slots; slot ++) {
+			ready.insert(ready.end(), found[slot].begin(), found[slot].end());
+			found[slot].clear();
+		}
+		if (ready.empty())
+			break;
+		ThreadPool::forRange(pool, ready.size(), chunkSize, [&](size_t begin, size_t end, int slot) {
+			vector<int> &seen = used[slot];
+			for (size_t i = begin; i < end; i ++) {
+				int node = ready[i];
+				for (size_t edge = offsets[node]; edge < offsets[node + 1]; edge ++) {
+					int neighbor = targets[edge];
+					if (before(neighbor, node))
+						seen[colors[neighbor]] = node;
+				}
+				int color = 0;
+				while (seen[color] == node)
+					color ++;
+				colors[node] = color;
+				for (size_t edge = offsets[node]; edge < offsets[node + 1]; edge ++) {
+					int neighbor = targets[edge];
+					if (before(node, neighbor) && waiting[neighbor].fetch_sub(1, memory_order_acq_rel) == 1)
+						found[slot].push_back(neighbor);
+				}
+			}
+		});
+	}
+
+	int colorCount = 0;
+	for (int i = 0; i < nodeCount; i ++)
+		colorCount = max(colorCount, colors[i] + 1);
+	return colorCount;
+}
+
+// A small, fast random generator (xorshift64*) so runs with the same seed match everywhere.
+
+class ColoringRandom {
+private:
+	uint64_t state;
+public:
+	ColoringRandom(unsigned seed) : state(((uint64_t)seed << 32) ^ 0x9E3779B97F4A7C15ULL) {}
+
+	uint64_t next() {
+		this->state ^= this->state >> 12;
+		this->state ^= this->state << 25;
+		this->state ^= this->state >> 27;
+		return this->state * 2685821657736338717ULL;
+	}
+
+	// A number in [0, limit).
+	int below(int limit) {
+		return (int)(this->next() % (uint64_t)limit);
+	}
+};
+
+// Keeps track of the budget. The clock is only looked at every so often, since it costs more than
+// a step does.
+
+class BudgetClock {
+private:
+	ColoringBudget budget;
+	chrono::steady_clock::time_point start;
+	long steps;
+	long nextCheck;
+	bool expired;
+public:
+	BudgetClock(const ColoringBudget &budget) : budget(budget), start(chrono::steady_clock::now()), steps(0), nextCheck(0), expired(false) {}
+
+	// Counts some steps. Returns whether the budget has run out.
+	bool spend(long count) {
+		this->steps += count;
+		if (this->budget.steps > 0 && this->steps >= this->budget.steps)
+			this->expired = true;
+		if (!this->expired && this->budget.seconds > 0 && this->steps >= this->nextCheck) {
+			this->nextCheck = this->steps + 1024;
+			double elapsed = chrono::duration<double>(chrono::steady_clock::now() - this->start).count();
+			if (elapsed >= this->budget.seconds)
+				this->expired = true;
+		}
+		return this->expired;
+	}
+
+	bool isExpired() const {
+		return this->expired;
+	}
+};
+
+// Renumbers colors to 0 .. count - 1, keeping their order. Returns the count.
+
+static int packColors(int nodeCount, int *colors) {
+	int maxColor = -1;
+	for (int i = 0; i < nodeCount; i ++)
+		maxColor = max(maxColor, colors[i]);
+	vector<int> label(maxColor + 1, -1);
+	for (int i = 0; i < nodeCount; i ++)
+		label[colors[i]] = 0;
+	int count = 0;
+	for (int color = 0; color <= maxColor; color ++) {
+		if (label[color] == 0)
+			label[color] = count ++;
+	}
+	for (int i = 0; i < nodeCount; i ++)
+		colors[i] = label[colors[i]];
+	return count;
+}
+
+// Hands each region's part of the graph to solve on its own and gives the regions' colors one range
+// after another, so no class ever spans two regions. Edges between regions are left out, since
+// their ends can never share a class anyway. solve(count, offsets, targets, nodes, colors) gets a
+// region's nodes renumbered from 0 (nodes has the number each one had) and their colors, and
+// returns how many colors it left them with. Returns the number of colors used in all.
+
+template <class Solve>
+static int solveByRegion(int nodeCount, const size_t *offsets, const int *targets, const int *regions, int *colors, Solve solve) {
+	int regionCount = 0;
+	for (int i = 0; i < nodeCount; i ++)
+		regionCount = max(regionCount, regions[i] + 1);
+	vector<int> regionStart(regionCount + 1, 0);
+	for (int i = 0; i < nodeCount; i ++)
+		regionStart[regions[i] + 1]++;
+	for (int region = 0; region < regionCount; region ++)
+		regionStart[region + 1] += regionStart[region];
+	vector<int> nodes(nodeCount);
+	vector<int> place(regionStart.begin(), regionStart.end() - 1);
+	for (int i = 0; i < nodeCount; i ++)
+		nodes[place[regions[i]]++] = i;
+
+	vector<int> local(nodeCount);
+	vector<size_t> subOffsets;
+	vector<int> subTargets;
+	vector<int> subColors;
+	int colorCount = 0;
+	for (int region = 0; region < regionCount; region ++) {
+		const int *regionNodes = &nodes[0] + regionStart[region];
+		int count = regionStart[region + 1] - regionStart[region];
+		if (count == 0)
+			continue;
+		for (int i = 0; i < count; i ++)
+			local[regionNodes[i]] = i;
+		subOffsets.assign(1, 0);
+		subTargets.clear();
+		subColors.resize(count);
+		for (int i = 0; i < count; i ++) {
+			int node = regionNodes[i];
+			for (size_t edge = offsets[node]; edge < offsets[node + 1]; edge ++) {
+				if (regions[targets[edge]] == region)
+					subTargets.push_back(local[targets[edge]]);
+			}
+			subOffsets.push_back(subTargets.size());
+			subColors[i] = colors[node];
+		}
+		int used = solve(count, &subOffsets[0], subTargets.empty() ? NULL : &subTargets[0], regionNodes, &subColors[0]);
+		for (int i = 0; i < count; i ++)
+			colors[regionNodes[i]] = colorCount + subColors[i];
+		colorCount += used;
+	}
+	return colorCount;
+}
+
+// The search itself. It holds on to all its buffers between rounds, since each tabu attempt needs
+// a count per node per color and a big graph would otherwise allocate those over and over.
+
+class ColoringImprover {
+private:
+	int nodeCount;
+	const size_t *offsets;
+	const int *targets;
+	BudgetClock clock;
+	ColoringRandom random;
+
+	// Iterated greedy.
+	vector<int> classSize;
+	vector<int> classOrder;
+	vector<int> classRank;
+	vector<int> classStart;
+	vector<int> order;
+	vector<int> newColors;
+	vector<int> seenBy;
+
+	// Tabu search.
+	vector<int> current;
+	vector<int> conflicts;
+	vector<long> tabuUntil;
+	vector<int> conflicted;
+	vector<int> place;
+
+	int &conflictsAt(int node, int color, int colorCount) {
+		return this->conflicts[(size_t)node * colorCount + color];
+	}
+	void updateConflicted(int node, int colorCount);
+	void countClasses(const int *colors, int colorCount);
+public:
+	ColoringImprover(int nodeCount, const size_t *offsets, const int *targets, const ColoringBudget &budget);
+	int iteratedGreedy(int *colors, int colorCount, int pass);
+	bool tabuSearch(int *colors, int colorCount, int removed, long maxSteps);
+	int pickRemoved(const int *colors, int colorCount);
+	BudgetClock &getClock() { return this->clock; }
+};
+
+ColoringImprover::ColoringImprover(int nodeCount, const size_t *offsets, const int *targets, const ColoringBudget &budget) : nodeCount(nodeCount), offsets(offsets), targets(targets), clock(budget), random(budget.seed) {
+	this->order.resize(nodeCount);
+	this->newColors.resize(nodeCount);
+}
+
+void ColoringImprover::countClasses(const int *colors, int colorCount) {
+	this->classSize.assign(colorCount, 0);
+	for (int i = 0; i < this->nodeCount; i ++)
+		this->classSize[colors[i]]++;
+}
+
+// One pass of iterated greedy. Nodes are visited a whole color class at a time, with the classes in
+// some new order, and each takes the smallest color its visited neighbors don't have. Every class
+// is independent, so no class can end up needing a color past the ones before it: the result never
+// has more colors than the input. Returns the new count.
+
+int ColoringImprover::iteratedGreedy(int *colors, int colorCount, int pass) {
+	this->countClasses(colors, colorCount);
+
+	// Culberson's orders: reversed, biggest classes first, and shuffled, in turn.
+	this->classOrder.resize(colorCount);
+	for (int color = 0; color < colorCount; color ++)
+		this->classOrder[color] = color;
+	switch (pass % 3) {
+		case 0:
+			reverse(this->classOrder.begin(), this->classOrder.end());
+			break;
+		case 1: {
+			const vector<int> &size = this->classSize;
+			stable_sort(this->classOrder.begin(), this->classOrder.end(), [&size](int a, int b) {
+				return size[a] > size[b];
+			});
+			break;
+		}
+		default:
+			for (int i = colorCount - 1; i > 0; i --)
+				swap(this->classOrder[i], this->classOrder[this->random.below(i + 1)]);
+			break;
+	}
+	this->classRank.resize(colorCount);
+	for (int i = 0; i < colorCount; i ++)
+		this->classRank[this->classOrder[i]] = i;
+
+	// Counting sort of the nodes by their class's place in the order.
+	this->classStart.assign(colorCount + 1, 0);
+	for (int i = 0; i < this->nodeCount; i ++)
+		this->classStart[this->classRank[colors[i]] + 1]++;
+	for (int i = 0; i < colorCount; i ++)
+		this->classStart[i + 1] += this->classStart[i];
+	for (int i = 0; i < this->nodeCount; i ++)
+		this->order[this->classStart[this->classRank[colors[i]]]++] = i;
+
+	fill(this->newColors.begin(), this->newColors.end(), -1);
+	this->seenBy.assign(colorCount + 1, -1);
+	int newCount = 0;
+	for (int i = 0; i < this->nodeCount; i ++) {
+		int node = this->order[i];
+		for (size_t edge = this->offsets[node]; edge < this->offsets[node + 1]; edge ++) {
+			int color = this->newColors[this->targets[edge]];
+			if (color != -1)
+				this->seenBy[color] = node;
+		}
+		int color = 0;
+		while (this->seenBy[color] == node)
+			color ++;
+		this->newColors[node] = color;
+		newCount = max(newCount, color + 1);
+	}
+	copy(this->newColors.begin(), this->newColors.end(), colors);
+	return newCount;
+}
+
+// One of the three smallest classes, so repeated attempts don't all go after the same one.
+
+int ColoringImprover::pickRemoved(const int *colors, int colorCount) {
+	this->countClasses(colors, colorCount);
+	this->classOrder.resize(colorCount);
+	for (int color = 0; color < colorCount; color ++)
+		this->classOrder[color] = color;
+	const vector<int> &size = this->classSize;
+	sort(this->classOrder.begin(), this->classOrder.end(), [&size](int a, int b) {
+		return size[a] < size[b] || (size[a] == size[b] && a < b);
+	});
+	return this->classOrder[this->random.below(min(3, colorCount))];
+}
+
+// Keeps the list of nodes with a neighbor of their own color up to date after node changed, or one
+// of its neighbors did.
+
+void ColoringImprover::updateConflicted(int node, int colorCount) {
+	bool isConflicted = this->conflictsAt(node, this->current[node], colorCount) > 0;
+	if (isConflicted && this->place[node] == -1) {
+		this->place[node] = (int)this->conflicted.size();
+		this->conflicted.push_back(node);
+	} else if (!isConflicted && this->place[node] != -1) {
+		int last = this->conflicted.back();
+		this->conflicted[this->place[node]] = last;
+		this->place[last] = this->place[node];
+		this->conflicted.pop_back();
+		this->place[node] = -1;
+	}
+}
+
+// TabuCol: tries to get rid of one color class, removed, by moving nodes between the other classes
+// until no two neighbors share a color. Each step makes the best move of a conflicting node to
+// another color that isn't tabu (or that beats the best seen so far), then forbids moving that
+// node back for a while. On success colors holds a valid coloring that doesn't use removed and
+// true is returned; otherwise colors is left as it was.
+
+bool ColoringImprover::tabuSearch(int *colors, int colorCount, int removed, long maxSteps) {
+	int nodeCount = this->nodeCount;
+	const size_t *offsets = this->offsets;
+	const int *targets = this->targets;
+	this->current.assign(colors, colors + nodeCount);
+
+	// Spread the removed class over the others, each node taking the color it clashes with least.
+	for (int node = 0; node < nodeCount; node ++) {
+		if (this->current[node] != removed)
+			continue;
+		int bestColor = -1;
+		int bestCount = 0;
+		for (int color = 0; color < colorCount; color ++) {
+			if (color == removed)
+				continue;
+			int count = 0;
+			for (size_t edge = offsets[node]; edge < offsets[node + 1]; edge ++)
+				count += (this->current[targets[edge]] == color);
+			if (bestColor == -1 || count < bestCount) {
+				bestColor = color;
+				bestCount = count;
+			}
+		}
+		this->current[node] = bestColor;
+	}
+	this->conflicts.assign((size_t)nodeCount * colorCount, 0);
+	for (int node = 0; node < nodeCount; node ++) {
+		for (size_t edge = offsets[node]; edge < offsets[node + 1]; edge ++)
+			this->conflictsAt(node, this->current[targets[edge]], colorCount)++;
+	}
+
+	this->conflicted.clear();
+	this->place.assign(nodeCount, -1);
+	long total = 0;
+	for (int node = 0; node < nodeCount; node ++) {
+		total += this->conflictsAt(node, this->current[node], colorCount);
+		this->updateConflicted(node, colorCount);
+	}
+	total /= 2;
+	long bestTotal = total;
+
+	this->tabuUntil.assign((size_t)nodeCount * colorCount, 0);
+	for (long step = 1; step <= maxSteps && total > 0; step ++) {
+		if (this->clock.spend(1))
+			return false;
+
+		// Find the best move. Ties are broken at random so the search doesn't go in circles.
+		int moveNode = -1;
+		int moveColor = -1;
+		int moveDelta = 0;
+		int ties = 0;
+		for (size_t i = 0; i < this->conflicted.size(); i ++) {
+			int node = this->conflicted[i];
+			int own = this->conflictsAt(node, this->current[node], colorCount);
+			for (int color = 0; color < colorCount; color ++) {
+				if (color == removed || color == this->current[node])
+					continue;
+				int delta = this->conflictsAt(node, color, colorCount) - own;
+				bool tabu = this->tabuUntil[(size_t)node * colorCount + color] >= step;
+				if (tabu && total + delta >= bestTotal)
+					continue;
+				if (moveNode == -1 || delta < moveDelta) {
+					moveNode = node;
+					moveColor = color;
+					moveDelta = delta;
+					ties = 1;
+				} else if (delta == moveDelta && this->random.below(++ ties) == 0) {
+					moveNode = node;
+					moveColor = color;
+				}
+			}
+		}
+		// Everything is tabu, so pick any conflicted node and color.
+		if (moveNode == -1) {
+			moveNode = this->conflicted[this->random.below((int)this->conflicted.size())];
+			do {
+				moveColor = this->random.below(colorCount);
+			} while (moveColor == removed || moveColor == this->current[moveNode]);
+			moveDelta = this->conflictsAt(moveNode, moveColor, colorCount) - this->conflictsAt(moveNode, this->current[moveNode], colorCount);
+		}
+
+		int oldColor = this->current[moveNode];
+		this->current[moveNode] = moveColor;
+		total += moveDelta;
+		bestTotal = min(bestTotal, total);
+		// The usual tenure: a little randomness plus a bit more the worse things are.
+		this->tabuUntil[(size_t)moveNode * colorCount + oldColor] = step + this->random.below(10) + (long)(0.6 * this->conflicted.size());
+
+		for (size_t edge = offsets[moveNode]; edge < offsets[moveNode + 1]; edge ++) {
+			int neighbor = targets[edge];
+			this->conflictsAt(neighbor, oldColor, colorCount)--;
+			this->conflictsAt(neighbor, moveColor, colorCount)++;
+			if (this->current[neighbor] == oldColor || this->current[neighbor] == moveColor)
+				this->updateConflicted(neighbor, colorCount);
+		}
+		this->updateConflicted(moveNode, colorCount);
+	}
+	if (total > 0)
+		return false;
+
+	copy(this->current.begin(), this->current.end(), colors);
+	return true;
+}
+
+// Tabu search keeps a count per node per color, so past this many it isn't worth it and only
+// iterated greedy runs.
+#define TABU_MAX_CELLS ((size_t)1 << 26)
+// How many steps one tabu attempt gets before going back to iterated greedy.
+#define TABU_ATTEMPT_STEPS 20000
+
+static int improveWhole(int nodeCount, const size_t *offsets, const int *targets, int *colors, const ColoringBudget &budget) {
+	if (nodeCount == 0)
+		return 0;
+	int colorCount = packColors(nodeCount, colors);
+	if (!budget.isSet())
+		return colorCount;
+
+	// Two colors is as good as it gets once there's an edge.
+	int fewest = (offsets[nodeCount] > 0 ? 2 : 1);
+
+	ColoringImprover improver(nodeCount, offsets, targets, budget);
+	BudgetClock &clock = improver.getClock();
+	vector<int> working(colors, colors + nodeCount);
+	int workingCount = colorCount;
+	for (int round = 0; colorCount > fewest && !clock.isExpired(); round ++) {
+		// A few greedy passes shake the classes up, and sometimes shed one on their own.
+		for (int pass = 0; pass < 3 && !clock.spend(nodeCount); pass ++) {
+			workingCount = improver.iteratedGreedy(&working[0], workingCount, round * 3 + pass);
+			if (workingCount < colorCount) {
+				colorCount = workingCount;
+				copy(working.begin(), working.end(), colors);
+			}
+		}
+		if (clock.isExpired() || colorCount <= fewest)
+			break;
+
+		// Then try to do without one of the smallest classes outright.
+		if ((size_t)nodeCount * workingCount > TABU_MAX_CELLS)
+			continue;
+		int removed = improver.pickRemoved(&working[0], workingCount);
+		if (improver.tabuSearch(&working[0], workingCount, removed, TABU_ATTEMPT_STEPS)) {
+			workingCount = packColors(nodeCount, &working[0]);
+			colorCount = workingCount;
+			copy(working.begin(), working.end(), colors);
+		}
+	}
+	return colorCount;
+}
+
+int improveColoring(int nodeCount, const size_t *offsets, const int *targets, const int *regions, int *colors, const ColoringBudget &budget) {
+	if (regions == NULL)
+		return improveWhole(nodeCount, offsets, targets, colors, budget);
+
+	// Each region gets an even share of the budget.
+	int regionCount = 0;
+	vector<bool> used;
+	for (int i = 0; i < nodeCount; i ++) {
+		if (regions[i] >= (int)used.size())
+			used.resize(regions[i] + 1, false);
+		regionCount += !used[regions[i]];
+		used[regions[i]] = true;
+	}
+	ColoringBudget share = budget;
+	if (regionCount > 1) {
+		share.seconds = budget.seconds / regionCount;
+		share.steps = (budget.steps > 0 ? max(budget.steps / regionCount, 1L) : 0);
+	}
+	return solveByRegion(nodeCount, offsets, targets, regions, colors, [&share](int count, const size_t *offsets, const int *targets, const int *, int *colors) {
+		return improveWhole(count, offsets, targets, colors, share);
+	});
+}
+
+// Moves nodes out of one class into others, lightest first. A node can go to a class that none of
+// its neighbors are in and that stays within limit with it; an empty class takes anything. Stops
+// once the class is within limit. Returns whether anything moved.
+
+static bool spillClass(int nodeCount, const size_t *offsets, const int *targets, const int *weights, int *colors, vector<long> &classWeight, vector<int> &classSize, int from, long limit, vector<int> &seenBy) {
+	bool moved = false;
+	int colorCount = (int)classWeight.size();
+	for (int node = 0; node < nodeCount && classWeight[from] > limit && classSize[from] > 1; node ++) {
+		if (colors[node] != from)
+			continue;
+		long weight = (weights != NULL ? weights[node] : 1);
+		for (size_t edge = offsets[node]; edge < offsets[node + 1]; edge ++)
+			seenBy[colors[targets[edge]]] = node;
+
+		int best = -1;
+		for (int color = 0; color < colorCount; color ++) {
+			if (color == from || seenBy[color] == node)
+				continue;
+			if (classSize[color] > 0 && classWeight[color] + weight > limit)
+				continue;
+			if (best == -1 || classWeight[color] < classWeight[best])
+				best = color;
+		}
+		// Only worth it if the sizes end up closer together.
+		if (best == -1 || classWeight[best] + weight >= classWeight[from])
+			continue;
+
+		colors[node] = best;
+		classWeight[from] -= weight;
+		classWeight[best] += weight;
+		classSize[from]--;
+		classSize[best]++;
+		moved = true;
+	}
+	return moved;
+}
+
+static int balanceWhole(int nodeCount, const size_t *offsets, const int *targets, const int *weights, int *colors, long capacity) {
+	if (nodeCount == 0)
+		return 0;
+	int colorCount = packColors(nodeCount, colors);
+
+	vector<long> classWeight(colorCount, 0);
+	vector<int> classSize(colorCount, 0);
+	long total = 0;
+	for (int node = 0; node < nodeCount; node ++) {
+		long weight = (weights != NULL ? weights[node] : 1);
+		classWeight[colors[node]] += weight;
+		classSize[colors[node]]++;
+		total += weight;
+	}
+	vector<int> seenBy(colorCount, -1);
+
+	// First get every class under the capacity, adding a color whenever moving between the ones
+	// there are gets stuck.
+	if (capacity > 0) {
+		while (true) {
+			bool over = false;
+			bool moved = false;
+			for (int color = 0; color < colorCount; color ++) {
+				if (classWeight[color] <= capacity || classSize[color] <= 1)
+					continue;
+				moved |= spillClass(nodeCount, offsets, targets, weights, colors, classWeight, classSize, color, capacity, seenBy);
+				over |= (classWeight[color] > capacity && classSize[color] > 1);
+			}
+			if (!over)
+				break;
+			if (!moved) {
+				classWeight.push_back(0);
+				classSize.push_back(0);
+				seenBy.push_back(-1);
+				colorCount ++;
+			}
+		}
+	}
+
+	// Then even them out: nothing bigger than the average if it can be helped. Every move makes a
+	// class above the average smaller, so this always finishes.
+	long average = (total + colorCount - 1) / colorCount;
+	bool moved = true;
+	while (moved) {
+		moved = false;
+		for (int color = 0; color < colorCount; color ++) {
+			if (classWeight[color] > average)
+				moved |= spillClass(nodeCount, offsets, targets, weights, colors, classWeight, classSize, color, average, seenBy);
+		}
+	}
+
+	return packColors(nodeCount, colors);
+}
+
+int balanceColoring(int nodeCount, const size_t *offsets, const int *targets, const int *weights, const int *regions, int *colors, long capacity) {
+	if (regions == NULL)
+		return balanceWhole(nodeCount, offsets, targets, weights, colors, capacity);
+	vector<int> subWeights;
+	return solveByRegion(nodeCount, offsets, targets, regions, colors, [weights, capacity, &subWeights](int count, const size_t *offsets, const int *targets, const int *nodes, int *colors) {
+		if (weights == NULL)
+			return balanceWhole(count, offsets, targets, NULL, colors, capacity);
+		subWeights.resize(count);
+		for (int i = 0; i < count; i ++)
+			subWeights[i] = weights[nodes[i]];
+		return balanceWhole(count, offsets, targets, &subWeights[0], colors, capacity);
+	});
+}
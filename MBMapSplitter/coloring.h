@@ -0,0 +1,109 @@
+//
+//  coloring.h
+//  MBMapSplitter
+//
+//  Copyright (c) 2015 HiGuy Smith
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#ifndef __MBMapSplitter__coloring__
+#define __MBMapSplitter__coloring__
+
+#include <stddef.h>
+
+class ThreadPool;
+
+// DSATUR on a graph in compressed form: the neighbors of node i are
+// targets[offsets[i]] .. targets[offsets[i + 1] - 1]. Nodes are colored in order of highest
+// saturation, then highest degree, then lowest position, and each gets the smallest color none of
+// its neighbors have; the same rules Graph::colorDSATUR has always used. Saturation is tracked
+// incrementally with a bitmask of neighbor colors per node, so nothing is rescanned.
+// Fills in colors (one per node) and returns the number of colors used.
+
+int colorDSATUR(int nodeCount, const size_t *offsets, const int *targets, int *colors);
+
+// Puts nodes in Morton order by the centers of their bounds (six numbers per node, as below), which
+// keeps nodes that are near each other mostly near each other in the order too. Ties go to the
+// lower node.
+
+void getMortonOrder(int count, const double *bounds, int *order);
+
+// The same order, but for keeping each color class in one part of the level. A node can take any
+// color none of its neighbors have, and takes the one whose class's bounds grow the least with it
+// (by volume, then by how far the sides move, then the lowest color). A new color is only used
+// when none of them fit. The last ties between nodes go by Morton order rather than position.
+// bounds has six numbers per node: the minimum x, y and z, then the maximum. With regions (one per
+// node, numbered from 0), a node only takes colors first used in its own region, so no class spans
+// two regions. Returns the number of colors used.
+
+int colorDSATURLocal(int nodeCount, const size_t *offsets, const int *targets, const double *bounds, const int *regions, int *colors);
+
+// DSATUR one connected component at a time, the components spread over a thread pool (or all on
+// the calling thread, if pool is NULL). Each component gets exactly the colors colorDSATUR would
+// give it, so there are just as many colors in all. Then, since no two components share an edge,
+// each one's colors are swapped around so its biggest class goes into the smallest class so far,
+// biggest components first; lots of little islands end up spread over the classes rather than all
+// piled into color 0. Returns the number of colors used.
+
+int colorComponents(int nodeCount, const size_t *offsets, const int *targets, int *colors, ThreadPool *pool);
+
+// Jones-Plassmann coloring on a thread pool (or the calling thread, if pool is NULL). Every node
+// gets a priority: highest degree first, then a random order picked by seed. A node is colored,
+// with the smallest color none of its neighbors have, once every neighbor that comes before it
+// has been. Nodes that are ready together are colored in parallel, in rounds. The result only
+// depends on the graph and the seed, never on the pool, and usually takes a color or two more
+// than colorDSATUR. Returns the number of colors used.
+
+int colorParallel(int nodeCount, const size_t *offsets, const int *targets, int *colors, ThreadPool *pool, unsigned seed);
+
+// How long improveColoring may look for. It stops at whichever limit comes first; a limit of zero
+// isn't a limit. A step is one node getting a new color. With only a step limit, the same graph,
+// coloring and seed always give the same result.
+
+struct ColoringBudget {
+	double seconds;
+	long steps;
+	unsigned seed;
+
+	ColoringBudget() : seconds(0), steps(0), seed(1) {}
+	bool isSet() const { return this->seconds > 0 || this->steps > 0; }
+};
+
+// Tries to color the graph with fewer colors than the valid coloring already in colors. It takes
+// turns between iterated greedy (recoloring greedily with the color classes in a new order, which
+// can never need more colors) and tabu search (TabuCol) for one color fewer, with the smallest
+// class spread over the others. colors always ends up holding the best valid coloring found, with
+// colors numbered from 0. With regions (one per node, as for colorDSATURLocal, and no class in
+// colors spanning two), each region is searched on its own with an even share of the budget, so
+// classes still never span two. Returns the number of colors it uses.
+
+int improveColoring(int nodeCount, const size_t *offsets, const int *targets, const int *regions, int *colors, const ColoringBudget &budget);
+
+// Moves nodes between the color classes of a valid coloring to even out their sizes. A class's
+// size is the sum of its nodes' weights (or its node count if weights is NULL). With a capacity,
+// no class ends up bigger than it, and a new color is only added when no existing class can take
+// a node; a node too big for the capacity on its own gets a class to itself. Without one (0), the
+// number of colors stays the same and classes are just brought as close to the average as they
+// can be. Nodes only ever move to a class none of their neighbors are in, so colors stays valid.
+// With regions, as for improveColoring, each region is balanced on its own and nodes only ever
+// move to classes in their own region. Returns the number of colors it uses.
+
+int balanceColoring(int nodeCount, const size_t *offsets, const int *targets, const int *weights, const int *regions, int *colors, long capacity);
+
+#endif
@@ -0,0 +1,289 @@
+//
+//  converter.cpp
+//  MBMapSplitter
+//
+//  Copyright (c) 2015 HiGuy Smith
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#include "converter.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+ConverterSlots::ConverterSlots(int count) : available(count) {
+
+}
+
+void ConverterSlots::acquire() {
+	std::unique_lock<std::mutex> guard(lock);
+	freed.wait(guard, [this]() {
+		return available > 0;
+	});
+	available --;
+}
+
+bool ConverterSlots::tryAcquire() {
+	std::lock_guard<std::mutex> guard(lock);
+	if (available <= 0) {
+		return false;
+	}
+	available --;
+	return true;
+}
+
+void ConverterSlots::release() {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		available ++;
+	}
+	freed.notify_one();
+}
+
+ConvertJob getConvertJob(const std::string &mapPath) {
+	ConvertJob job;
+	job.mapPath = mapPath;
+	size_t dot = mapPath.find_last_of('.');
+	size_t slash = mapPath.find_last_of("/\\");
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+		dot = mapPath.size();
+	}
+	job.outputPath = mapPath.substr(0, dot) + ".dif";
+	job.logPath = mapPath + ".log";
+	return job;
+}
+
+//Single quotes keep the shell from doing anything with the path, so only they need escaping
+static std::string quote(const std::string &text) {
+	std::string quoted("'");
+	for (size_t i = 0; i < text.size(); i ++) {
+		if (text[i] == '\'') {
+			quoted += "'\\''";
+		} else {
+			quoted += text[i];
+		}
+	}
+	quoted += "'";
+	return quoted;
+}
+
+static void replaceAll(std::string &text, const std::string &from, const std::string &to) {
+	for (size_t pos = text.find(from); pos != std::string::npos; pos = text.find(from, pos + to.size())) {
+		text.replace(pos, from.size(), to);
+	}
+}
+
+static std::string getCommand(const std::string &command, const ConvertJob &job) {
+	size_t slash = job.mapPath.find_last_of("/\\");
+	std::string directory = (slash == std::string::npos ? "." : job.mapPath.substr(0, slash == 0 ? 1 : slash));
+
+	std::string expanded(command);
+	bool hasMap = (expanded.find("{map}") != std::string::npos);
+	replaceAll(expanded, "{map}", quote(job.mapPath));
+	replaceAll(expanded, "{dif}", quote(job.outputPath));
+	replaceAll(expanded, "{dir}", quote(directory));
+	if (!hasMap) {
+		expanded += " " + quote(job.mapPath);
+	}
+	return expanded;
+}
+
+#ifdef _WIN32
+
+size_t runConverter(const std::string &command, std::vector<ConvertJob> &jobs, ConverterSlots &slots) {
+	for (size_t i = 0; i < jobs.size(); i ++) {
+		jobs[i].succeeded = false;
+		FILE *log = fopen(jobs[i].logPath.c_str(), "w");
+		if (log != NULL) {
+			fputs("Running a converter isn't supported on Windows.\n", log);
+			fclose(log);
+		}
+	}
+	return 0;
+}
+
+#else
+
+//A converter that's been started and hasn't been cleaned up after yet
+struct RunningJob {
+	size_t index;
+	pid_t pid;
+	int output;
+	FILE *log;
+	//The end of what it printed last time, in case "Fatal:" is split between two reads
+	std::string tail;
+	bool fatal;
+};
+
+//Only one converter gets started at a time, so every descriptor is marked close-on-exec before
+//any other converter can start and inherit it. One that leaked would keep another job's pipe open
+//until this one finished, and we'd think it was still running.
+static std::mutex gStartLock;
+
+static bool startJob(const std::string &command, const ConvertJob &job, RunningJob &running) {
+	//Done before the fork, since the child can't safely allocate anything
+	std::string expanded = getCommand(command, job);
+	const char *commandText = expanded.c_str();
+
+	std::lock_guard<std::mutex> guard(gStartLock);
+	FILE *log = fopen(job.logPath.c_str(), "w");
+	if (log == NULL) {
+		return false;
+	}
+	fcntl(fileno(log), F_SETFD, FD_CLOEXEC);
+
+	int fds[2];
+	if (pipe(fds) != 0) {
+		fclose(log);
+		return false;
+	}
+	fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+	fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+
+	pid_t pid = fork();
+	if (pid == 0) {
+		//Everything it prints goes down the pipe, and it gets nothing to read
+		int input = open("/dev/null", O_RDONLY);
+		if (input != -1) {
+			dup2(input, 0);
+		}
+		dup2(fds[1], 1);
+		dup2(fds[1], 2);
+		execl("/bin/sh", "sh", "-c", commandText, (char *)NULL);
+		_exit(127);
+	}
+	close(fds[1]);
+	if (pid < 0) {
+		close(fds[0]);
+		fclose(log);
+		return false;
+	}
+
+	running.pid = pid;
+	running.output = fds[0];
+	running.log = log;
+	running.fatal = false;
+	return true;
+}
+
+//Logs some output, and looks for the same "Fatal:" the old driver did
+static void readOutput(RunningJob &running, const char *data, size_t length) {
+	fwrite(data, 1, length, running.log);
+
+	std::string text(running.tail);
+	text.append(data, length);
+	if (text.find("Fatal:") != std::string::npos) {
+		running.fatal = true;
+	}
+	size_t keep = std::min(text.size(), strlen("Fatal:") - 1);
+	running.tail = text.substr(text.size() - keep);
+}
+
+//Its output has closed, so it's done (or as good as): wait for it and see how it went
+static bool finishJob(RunningJob &running, const ConvertJob &job) {
+	close(running.output);
+	fclose(running.log);
+
+	int status = 0;
+	while (waitpid(running.pid, &status, 0) < 0 && errno == EINTR) {
+		//Try again
+	}
+	bool succeeded = WIFEXITED(status) && WEXITSTATUS(status) == 0 && !running.fatal;
+	if (!succeeded) {
+		remove(job.outputPath.c_str());
+	}
+	return succeeded;
+}
+
+size_t runConverter(const std::string &command, std::vector<ConvertJob> &jobs, ConverterSlots &slots) {
+	std::vector<RunningJob> running;
+	std::vector<pollfd> fds;
+	size_t next = 0;
+	size_t succeeded = 0;
+	char buffer[64 << 10];
+
+	while (next < jobs.size() || !running.empty()) {
+		//Start as many as there are slots for. With nothing of ours running there's nothing else
+		//to wait on, so wait for a slot instead.
+		while (next < jobs.size()) {
+			if (running.empty()) {
+				slots.acquire();
+			} else if (!slots.tryAcquire()) {
+				break;
+			}
+			RunningJob job;
+			job.index = next ++;
+			jobs[job.index].succeeded = false;
+			if (!startJob(command, jobs[job.index], job)) {
+				remove(jobs[job.index].outputPath.c_str());
+				slots.release();
+				continue;
+			}
+			running.push_back(job);
+		}
+		if (running.empty()) {
+			continue;
+		}
+
+		//Sleep until one of them has something to say or hangs up
+		fds.resize(running.size());
+		for (size_t i = 0; i < running.size(); i ++) {
+			fds[i].fd = running[i].output;
+			fds[i].events = POLLIN;
+			fds[i].revents = 0;
+		}
+		if (poll(fds.data(), fds.size(), -1) < 0) {
+			continue;
+		}
+
+		//Backwards, so taking one out doesn't move the ones still to check
+		for (size_t i = running.size(); i -- > 0; ) {
+			if (fds[i].revents == 0) {
+				continue;
+			}
+			ssize_t got = read(running[i].output, buffer, sizeof(buffer));
+			if (got > 0) {
+				readOutput(running[i], buffer, (size_t)got);
+				continue;
+			}
+			if (got < 0 && (errno == EINTR || errno == EAGAIN)) {
+				continue;
+			}
+			ConvertJob &job = jobs[running[i].index];
+			job.succeeded = finishJob(running[i], job);
+			if (job.succeeded) {
+				succeeded ++;
+			}
+			slots.release();
+			running.erase(running.begin() + i);
+		}
+	}
+
+	return succeeded;
+}
+
+#endif
@@ -0,0 +1,80 @@
+//
+//  converter.h
+//  MBMapSplitter
+//
+//  Copyright (c) 2015 HiGuy Smith
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#ifndef __MBMapSplitter__converter__
+#define __MBMapSplitter__converter__
+
+#include <stddef.h>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//Runs the converter (map2dif or anything that works like it) on split maps. Every split gets its
+//own process, as many at once as there are slots, and its own log of everything it printed. The
+//processes are watched rather than polled: the runner sleeps until one of them prints something
+//or exits. Like the old map2dif driver, a converter that exits with anything but 0 or prints
+//"Fatal:" failed, and whatever it left behind at its output path is removed.
+
+//How many converters can run at once. One of these is shared by every map being split, so a batch
+//doesn't start a whole set of converters per map.
+class ConverterSlots {
+	std::mutex lock;
+	std::condition_variable freed;
+	int available;
+
+	ConverterSlots(const ConverterSlots &other) = delete;
+	ConverterSlots &operator=(const ConverterSlots &other) = delete;
+public:
+	ConverterSlots(int count);
+
+	//Waits for a slot
+	void acquire();
+	//Takes a slot only if there's one free right now
+	bool tryAcquire();
+	void release();
+};
+
+//One split map to convert
+struct ConvertJob {
+	std::string mapPath;
+	//Where the converter is expected to put the dif, removed if it fails
+	std::string outputPath;
+	//Where everything it prints goes
+	std::string logPath;
+	bool succeeded;
+
+	ConvertJob() : succeeded(false) {}
+};
+
+//Fills in a job for mapPath: the dif goes next to it, as does a log named after it
+ConvertJob getConvertJob(const std::string &mapPath);
+
+//Runs command on every job through /bin/sh, using slots and setting each job's succeeded. In the
+//command, {map}, {dif} and {dir} are replaced with the split map, the dif it should turn into and
+//the directory they're in, all quoted. Without a {map}, the split map goes on the end. Returns
+//how many succeeded.
+size_t runConverter(const std::string &command, std::vector<ConvertJob> &jobs, ConverterSlots &slots);
+
+#endif
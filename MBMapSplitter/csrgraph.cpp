@@ -0,0 +1,128 @@
+//
+//  csrgraph.cpp
+//  MBMapSplitter
+//
+//  Copyright (c) 2015 HiGuy Smith
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#include <algorithm>
+#include "csrgraph.h"
+
+// Creates a graph with no nodes.
+
+CSRGraph::CSRGraph() : nodeCount(0), offsets(1, 0) {
+}
+
+// Builds the graph from a list of edges between node numbers. The edges can come in any order
+// and either direction; duplicates are merged and loops (a node touching itself) are dropped.
+// This is two counting passes and a sort of each node's (usually tiny) neighbor list, so there
+// is never a second copy of the whole edge list.
+
+CSRGraph::CSRGraph(int nodeCount, const vector<pair<int, int> > &edges) : nodeCount(nodeCount), offsets(nodeCount + 1, 0) {
+	vector<pair<int, int> >::const_iterator it;
+	for (it = edges.begin(); it != edges.end(); it++) {
+		if (it->first == it->second)
+			continue;
+		this->offsets[it->first + 1]++;
+		this->offsets[it->second + 1]++;
+	}
+	for (int i = 0; i < nodeCount; i++)
+		this->offsets[i + 1] += this->offsets[i];
+
+	this->targets.resize(this->offsets[nodeCount]);
+	vector<size_t> fill(this->offsets.begin(), this->offsets.end() - 1);
+	for (it = edges.begin(); it != edges.end(); it++) {
+		if (it->first == it->second)
+			continue;
+		this->targets[fill[it->first]++] = it->second;
+		this->targets[fill[it->second]++] = it->first;
+	}
+
+	// Sort each list and squeeze out the duplicates, moving everything down as we go.
+	size_t write = 0;
+	for (int i = 0; i < nodeCount; i++) {
+		vector<int>::iterator begin = this->targets.begin() + this->offsets[i];
+		vector<int>::iterator end = this->targets.begin() + this->offsets[i + 1];
+		sort(begin, end);
+		end = unique(begin, end);
+		this->offsets[i] = write;
+		for (vector<int>::iterator jt = begin; jt != end; jt++)
+			this->targets[write++] = *jt;
+	}
+	this->offsets[nodeCount] = write;
+	this->targets.resize(write);
+	this->targets.shrink_to_fit();
+}
+
+// Returns the number of nodes.
+
+int CSRGraph::getNodeCount() const {
+	return this->nodeCount;
+}
+
+// Returns the number of edges. Each edge is stored once at both of its ends.
+
+size_t CSRGraph::getEdgeCount() const {
+	return this->targets.size() / 2;
+}
+
+// Returns the number of neighbors a node has.
+
+int CSRGraph::getDegree(int node) const {
+	return (int)(this->offsets[node + 1] - this->offsets[node]);
+}
+
+// Returns the range holding a node's neighbors, in increasing order.
+
+const int *CSRGraph::neighborsBegin(int node) const {
+	return this->targets.data() + this->offsets[node];
+}
+
+const int *CSRGraph::neighborsEnd(int node) const {
+	return this->targets.data() + this->offsets[node + 1];
+}
+
+// Returns whether two nodes are connected. This is a binary search of the smaller list.
+
+bool CSRGraph::isEdge(int node1, int node2) const {
+	if (this->getDegree(node2) < this->getDegree(node1))
+		swap(node1, node2);
+	return binary_search(this->neighborsBegin(node1), this->neighborsEnd(node1), node2);
+}
+
+// Appends every edge to the list once, as (higher node, lower node), sorted.
+
+void CSRGraph::getEdges(vector<pair<int, int> > &edges) const {
+	edges.reserve(edges.size() + this->getEdgeCount());
+	for (int i = 0; i < this->nodeCount; i++) {
+		for (const int *it = this->neighborsBegin(i); it != this->neighborsEnd(i) && *it < i; it++)
+			edges.push_back(make_pair(i, *it));
+	}
+}
+
+// Direct access to the arrays, for the algorithms that want to walk them themselves.
+
+const size_t *CSRGraph::getOffsets() const {
+	return this->offsets.data();
+}
+
+const int *CSRGraph::getTargets() const {
+	return this->targets.data();
+}
@@ -0,0 +1,57 @@
+//
+//  csrgraph.h
+//  MBMapSplitter
+//
+//  Copyright (c) 2015 HiGuy Smith
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#ifndef __MBMapSplitter__csrgraph__
+#define __MBMapSplitter__csrgraph__
+
+#include <stddef.h>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// An undirected graph in compressed sparse row form. Nodes are numbered 0 .. nodeCount - 1, and
+// the neighbors of node i are the sorted range targets[offsets[i]] .. targets[offsets[i + 1] - 1].
+// It can't be edited, only rebuilt; which is fine, since we build it once and then read it a lot.
+
+class CSRGraph {
+private:
+	int nodeCount;
+	vector<size_t> offsets;
+	vector<int> targets;
+public:
+	CSRGraph();
+	CSRGraph(int nodeCount, const vector<pair<int, int> > &edges);
+	int getNodeCount() const;
+	size_t getEdgeCount() const;
+	int getDegree(int node) const;
+	const int *neighborsBegin(int node) const;
+	const int *neighborsEnd(int node) const;
+	bool isEdge(int node1, int node2) const;
+	void getEdges(vector<pair<int, int> > &edges) const;
+	const size_t *getOffsets() const;
+	const int *getTargets() const;
+};
+
+#endif
@@ -23,7 +23,8 @@
 //  THE SOFTWARE.
 
 #include <stdio.h>
-#include "aabbcolor.h"
+#include "converter.h"
+#include "mapsplitter.h"
 
 #include <string>
 #include <vector>
@@ -31,82 +32,53 @@
 #include <iostream>
 #include <fstream>
 #include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
 
-#define MIN(a, b) ((a) < (b) ? (a) : (b))
-#define MAX(a, b) ((a) > (b) ? (a) : (b))
-
-AABB getBrushAABB(const std::string input) {
-	//Find all points within ()
-
-	std::vector<std::string> verts;
-
-	bool inVert = false;
-	std::string currentVert;
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <glob.h>
+#include <sys/stat.h>
+#endif
 
-	for (int i = 0; i < input.length(); i ++) {
-		char cur = input[i];
-		if (cur == '(') {
-			inVert = true;
-			currentVert.clear();
-			continue;
-		}
-		if (cur == ')') {
-			inVert = false;
-			verts.push_back(currentVert);
-			continue;
-		}
-		if (inVert) {
-			currentVert += cur;
-		}
+//Every allocation the program makes goes through here, so --stats can count them
+static void *countedAlloc(size_t size) {
+	countAllocation(size);
+	void *memory = malloc(size == 0 ? 1 : size);
+	if (memory == NULL) {
+		throw std::bad_alloc();
 	}
+	return memory;
+}
 
-	//Now that we have the verts, AABB em
-	double aabb[6];
-	aabb[0] = INT_MAX;
-	aabb[1] = INT_MAX;
-	aabb[2] = INT_MAX;
-	aabb[3] = INT_MIN;
-	aabb[4] = INT_MIN;
-	aabb[5] = INT_MIN;
-
-	for (int i = 0; i < verts.size(); i ++) {
-		std::string vert = verts[i];
-
-		std::string buf;
-		std::stringstream stream(vert);
-		std::vector<std::string> tokens;
-
-		while (stream >> buf) {
-			tokens.push_back(buf);
-		}
+void *operator new(size_t size) {
+	return countedAlloc(size);
+}
 
-		aabb[0] = MIN(aabb[0], atof(tokens[0].c_str()));
-		aabb[1] = MIN(aabb[1], atof(tokens[1].c_str()));
-		aabb[2] = MIN(aabb[2], atof(tokens[2].c_str()));
-		aabb[3] = MAX(aabb[3], atof(tokens[0].c_str()));
-		aabb[4] = MAX(aabb[4], atof(tokens[1].c_str()));
-		aabb[5] = MAX(aabb[5], atof(tokens[2].c_str()));
-	}
+void *operator new[](size_t size) {
+	return countedAlloc(size);
+}
 
-	return AABB(aabb[0], aabb[1], aabb[2], aabb[3], aabb[4], aabb[5]);
+void operator delete(void *memory) noexcept {
+	free(memory);
 }
 
-std::string readFile(const char *path) {
-	std::string conts;
-	std::ifstream stream;
-	stream.open(path);
+void operator delete[](void *memory) noexcept {
+	free(memory);
+}
 
-	if (!stream.is_open()) {
-		return std::string();
-	}
-	std::string line;
-	while (getline(stream, line, '\n')) {
-		conts.append(line);
-		conts.append("\n");
-	}
-	stream.close();
+//The sized ones C++14 calls when it knows the size, which must match the ones above
+void operator delete(void *memory, size_t) noexcept {
+	free(memory);
+}
 
-	return conts;
+void operator delete[](void *memory, size_t) noexcept {
+	free(memory);
 }
 
 void convertPath(std::string &path) {
@@ -136,143 +108,641 @@ std::string stripExt(const std::string &path) {
 }
 
 void printUsage(const char *executable) {
-	std::cout << "Usage: " << executable << " <map file> [-e export file [-p prefix]]" << std::endl;
+	std::cout << "Usage: " << executable << " <map file|directory|pattern|@list file> [-e export file [-p prefix]] [-c auto|brute|sweep|grid] [--local] [-r regions] [--parallel-color] [--exact[=tolerance]] [-t threads] [-i seconds] [-I steps] [-s brushes|-f faces] [--balance] [-x converter command [-j jobs]] [--cache] [--stream] [--stats[=json]]" << std::endl;
+	std::cout << "With more than one map, -e names a directory for each map's exports. List files have one map per line, each optionally followed by its own -e, -p, --cache and --stream." << std::endl;
+	std::cout << "--cache keeps what was worked out about each map in a .mbcache file next to it, so unchanged parts aren't redone next time." << std::endl;
+	std::cout << "--stream reads the map twice instead of keeping it in memory, for maps too big to fit. It can't be used with --cache." << std::endl;
+	std::cout << "--local keeps each split map in as small a part of the level as it can, so the engine can cull it. -r first cuts the level into that many regions and keeps every split map inside one, which makes for more split maps. --stats shows how much volume each split map's bounds cover." << std::endl;
+	std::cout << "--parallel-color colors on every thread instead of one, for huge maps. It usually makes a split map or two more. --local and -r go one brush at a time, so they turn it off." << std::endl;
+	std::cout << "--exact tests the brushes whose bounds touch again, as the shapes they really are, so brushes that only touch or just miss each other can share a split map. They have to overlap by more than the tolerance (default 0.01) to collide; a negative one counts brushes that close as colliding. --stream skips it." << std::endl;
+	std::cout << "-i and -I keep looking for a coloring with fewer colors, so fewer split maps, for up to that many seconds or steps. With only -I the result is the same every time." << std::endl;
+	std::cout << "-s and -f cap how many brushes or faces each split map can have, adding split maps only when they're needed. --balance evens out the split maps' sizes without adding any." << std::endl;
+	std::cout << "-x runs a converter like map2dif on every split map, -j at a time. In the command, {map}, {dif} and {dir} stand for the split map, the dif it should become and their directory; without {map} the split map goes on the end. Each one's output goes to a .log next to its split map, and only the ones that worked go in the exports file." << std::endl;
+	std::cout << "--stats prints how long each stage took, how much it allocated and how much memory it peaked at, as a table or as one line of JSON per map. Batches are split one map at a time with it on." << std::endl;
 }
 
-void writeCstring(std::ostream &stream, const char *string) {
-	stream.write(string, strlen(string));
+bool parseBroadPhase(const char *name, BroadPhase &method) {
+	if (!strcmp(name, "auto")) {
+		method = BroadPhaseAuto;
+	} else if (!strcmp(name, "brute")) {
+		method = BroadPhaseBruteForce;
+	} else if (!strcmp(name, "sweep")) {
+		method = BroadPhaseSweep;
+	} else if (!strcmp(name, "grid")) {
+		method = BroadPhaseGrid;
+	} else {
+		return false;
+	}
+	return true;
 }
 
-int main(int argc, const char **argv) {
-	//Make sure arguments are correct
-	if ((argc < 2 || argc == 3 || argc == 5) ||
-		(argc > 3 && strcmp(argv[2], "-e"))  ||
-		(argc > 5 && strcmp(argv[4], "-p"))) {
-		printUsage(argv[0]);
-		return 1;
+enum StatsMode {
+	StatsNone,
+	StatsTable,
+	StatsJSON
+};
+
+//One map to split, and where its exports go (if anywhere)
+struct MapJob {
+	std::string path;
+	std::string exportFile;
+	std::string prefix;
+	bool cache;
+	bool stream;
+
+	MapJob() : cache(false), stream(false) {}
+};
+
+//Options for the whole run rather than for one map
+struct Settings {
+	BroadPhase broadPhase;
+	bool local;
+	int regions;
+	bool parallelColor;
+	bool narrowPhase;
+	double touchTolerance;
+	int threads;
+	StatsMode stats;
+	ColoringBudget improve;
+	long maxPartSize;
+	bool countFaces;
+	bool balance;
+	std::string converter;
+	int converterJobs;
+
+	Settings() : broadPhase(BroadPhaseAuto), local(false), regions(0), parallelColor(false), narrowPhase(false), touchTolerance(SplitOptions().touchTolerance), threads(ThreadPool::getDefaultThreadCount()), stats(StatsNone), maxPartSize(0), countFaces(false), balance(false), converterJobs(ThreadPool::getDefaultThreadCount()) {}
+};
+
+//Reads options from argv[start] onwards into job. Every option but --cache, --stream, --stats,
+//--balance, --local, --parallel-color and --exact takes a value. Leave settings NULL to only allow
+//the per-map options.
+bool parseOptions(int argc, const char **argv, int start, MapJob &job, Settings *settings) {
+	for (int i = start; i < argc; i ++) {
+		if (!strcmp(argv[i], "--cache")) {
+			job.cache = true;
+			continue;
+		}
+		if (!strcmp(argv[i], "--stream")) {
+			job.stream = true;
+			continue;
+		}
+		if (!strcmp(argv[i], "--stats") && settings != NULL) {
+			settings->stats = StatsTable;
+			continue;
+		}
+		if (!strcmp(argv[i], "--stats=json") && settings != NULL) {
+			settings->stats = StatsJSON;
+			continue;
+		}
+		if (!strcmp(argv[i], "--balance") && settings != NULL) {
+			settings->balance = true;
+			continue;
+		}
+		if (!strcmp(argv[i], "--local") && settings != NULL) {
+			settings->local = true;
+			continue;
+		}
+		if (!strcmp(argv[i], "--parallel-color") && settings != NULL) {
+			settings->parallelColor = true;
+			continue;
+		}
+		if (!strcmp(argv[i], "--exact") && settings != NULL) {
+			settings->narrowPhase = true;
+			continue;
+		}
+		if (!strncmp(argv[i], "--exact=", 8) && settings != NULL) {
+			char *end;
+			settings->touchTolerance = strtod(argv[i] + 8, &end);
+			if (end == argv[i] + 8 || *end != '\0') {
+				return false;
+			}
+			settings->narrowPhase = true;
+			continue;
+		}
+		if (i + 1 >= argc) {
+			return false;
+		}
+		if (!strcmp(argv[i], "-e")) {
+			job.exportFile = argv[i + 1];
+		} else if (!strcmp(argv[i], "-p")) {
+			job.prefix = argv[i + 1];
+		} else if (!strcmp(argv[i], "-c") && settings != NULL && parseBroadPhase(argv[i + 1], settings->broadPhase)) {
+			//Collision method, already parsed
+		} else if (!strcmp(argv[i], "-r") && settings != NULL && atoi(argv[i + 1]) > 0) {
+			settings->regions = atoi(argv[i + 1]);
+		} else if (!strcmp(argv[i], "-t") && settings != NULL && atoi(argv[i + 1]) > 0) {
+			settings->threads = atoi(argv[i + 1]);
+		} else if (!strcmp(argv[i], "-i") && settings != NULL && atof(argv[i + 1]) > 0) {
+			settings->improve.seconds = atof(argv[i + 1]);
+		} else if (!strcmp(argv[i], "-I") && settings != NULL && atol(argv[i + 1]) > 0) {
+			settings->improve.steps = atol(argv[i + 1]);
+		} else if ((!strcmp(argv[i], "-s") || !strcmp(argv[i], "-f")) && settings != NULL && atol(argv[i + 1]) > 0) {
+			settings->maxPartSize = atol(argv[i + 1]);
+			settings->countFaces = (argv[i][1] == 'f');
+		} else if (!strcmp(argv[i], "-x") && settings != NULL && argv[i + 1][0] != '\0') {
+			settings->converter = argv[i + 1];
+		} else if (!strcmp(argv[i], "-j") && settings != NULL && atoi(argv[i + 1]) > 0) {
+			settings->converterJobs = atoi(argv[i + 1]);
+		} else {
+			return false;
+		}
+		i ++;
+	}
+	//Prefix only makes sense with an export file
+	if (!job.prefix.empty() && job.exportFile.empty()) {
+		return false;
+	}
+	//The cache needs all the brush text at once, which is what streaming is trying to avoid
+	if (job.cache && job.stream) {
+		return false;
 	}
+	return true;
+}
 
-	//Read the map
-	std::string mapConts = readFile(argv[1]);
-	if (mapConts.length() == 0) {
-		std::cout << "Invalid input file " << argv[1] << std::endl;
-		return 2;
+bool isMapName(const std::string &name) {
+	if (name.length() < 4) {
+		return false;
 	}
+	std::string ext = name.substr(name.length() - 4);
+	std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+	return ext == ".map";
+}
 
-	//Split it into pieces
-	std::string header;
-	std::string currentBrush;
-	std::vector<AABB> AABBs;
-	std::vector<std::string> brushes;
+//Finds every map in a directory, or every map matching a wildcard pattern
+void listMaps(const std::string &input, bool directory, std::vector<std::string> &maps) {
+#ifdef _WIN32
+	//FindFirstFile does the wildcards itself, it just doesn't tell us the directory
+	std::string pattern = (directory ? input + "\\*.map" : input);
+	std::string base;
+	size_t slash = pattern.find_last_of("\\/");
+	if (slash != std::string::npos) {
+		base = pattern.substr(0, slash + 1);
+	}
 
-	int inGroups = 0;
-	bool foundHeader = false;
+	WIN32_FIND_DATAA found;
+	HANDLE find = FindFirstFileA(pattern.c_str(), &found);
+	if (find == INVALID_HANDLE_VALUE) {
+		return;
+	}
+	do {
+		if (!(found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && isMapName(found.cFileName)) {
+			maps.push_back(base + found.cFileName);
+		}
+	} while (FindNextFileA(find, &found));
+	FindClose(find);
+#else
+	if (directory) {
+		DIR *dir = opendir(input.c_str());
+		if (dir == NULL) {
+			return;
+		}
+		while (struct dirent *entry = readdir(dir)) {
+			std::string path = input + "/" + entry->d_name;
+			struct stat info;
+			if (isMapName(entry->d_name) && stat(path.c_str(), &info) == 0 && S_ISREG(info.st_mode)) {
+				maps.push_back(path);
+			}
+		}
+		closedir(dir);
+	} else {
+		glob_t found;
+		if (glob(input.c_str(), 0, NULL, &found) == 0) {
+			for (size_t i = 0; i < found.gl_pathc; i ++) {
+				if (isMapName(found.gl_pathv[i])) {
+					maps.push_back(found.gl_pathv[i]);
+				}
+			}
+		}
+		globfree(&found);
+	}
+#endif
 
-	for (int i = 0; i < mapConts.length(); i ++) {
-		char cur = mapConts[i];
-		if (cur == '{') {
-			inGroups ++;
+	std::sort(maps.begin(), maps.end());
 
-			//Worldspawn group start
-			if (inGroups == 1) {
+	//Don't split our own output again: skip mapname-0.map if mapname.map is here too
+	std::vector<std::string> sources;
+	for (size_t i = 0; i < maps.size(); i ++) {
+		std::string stem = stripExt(maps[i]);
+		size_t dash = stem.find_last_of("-");
+		if (dash != std::string::npos && dash + 1 < stem.length() && stem.find_first_not_of("0123456789", dash + 1) == std::string::npos) {
+			std::string source = stem.substr(0, dash) + maps[i].substr(stem.length());
+			if (std::binary_search(maps.begin(), maps.end(), source)) {
 				continue;
 			}
+		}
+		sources.push_back(maps[i]);
+	}
+	maps.swap(sources);
+}
 
-			foundHeader = true;
+//Where a map's exports go when it's one of many: mapname.cs in the -e directory
+std::string getBatchExportFile(const std::string &directory, const std::string &mapPath) {
+	return directory + "/" + stripExt(stripPath(mapPath)) + ".cs";
+}
 
-			currentBrush.clear();
+//Reads a list file: one map per line, each optionally followed by its own -e and -p. Blank lines
+//and lines starting with # are skipped. Anything not given on a line comes from defaults.
+bool readMapList(const char *listPath, const MapJob &defaults, std::vector<MapJob> &jobs) {
+	std::ifstream list;
+	list.open(listPath);
+	if (!list.is_open()) {
+		std::cout << "Could not open list file " << listPath << std::endl;
+		return false;
+	}
+
+	std::string line;
+	int lineNumber = 0;
+	while (getline(list, line, '\n')) {
+		lineNumber ++;
+		std::istringstream stream(line);
+		std::vector<std::string> words;
+		std::string word;
+		while (stream >> word) {
+			words.push_back(word);
 		}
-		if (inGroups == 1 && !foundHeader) {
-			header += cur;
+		if (words.empty() || words[0][0] == '#') {
+			continue;
 		}
-		if (inGroups == 2) {
-			currentBrush += cur;
+
+		std::vector<const char *> args;
+		for (size_t i = 0; i < words.size(); i ++) {
+			args.push_back(words[i].c_str());
 		}
-		if (cur == '}') {
-			inGroups --;
-			if (inGroups < 0) {
-				std::cout << "Mismatched end brace in " << argv[1] << std::endl;
-				return 3;
-			}
-			//End of brush
-			if (inGroups == 1) {
-				brushes.push_back(currentBrush);
-				AABBs.push_back(getBrushAABB(currentBrush));
-			}
+
+		MapJob job;
+		job.path = words[0];
+		job.cache = defaults.cache;
+		job.stream = defaults.stream;
+		if (!parseOptions((int)args.size(), args.data(), 1, job, NULL)) {
+			std::cout << "Bad options on line " << lineNumber << " of " << listPath << std::endl;
+			return false;
+		}
+		if (job.exportFile.empty() && !defaults.exportFile.empty()) {
+			job.exportFile = getBatchExportFile(defaults.exportFile, job.path);
+			job.prefix = defaults.prefix;
 		}
+		jobs.push_back(job);
 	}
+	return true;
+}
 
-	std::cout << "Found " << brushes.size() << " brushes." << std::endl;
-
-	//Split algorithm by Whirligig231
-	Graph graph = getCollisions(AABBs);
-	graph.colorDSATUR();
-
-	//Export sets
-	int **colorSets = graph.getColorSets();
-	for (int i = 0; colorSets[i] != NULL; i ++) {
-		// path/to/mapname-0.map
-		std::string path(argv[1]);
+// path/to/mapname-0.map, and so on
+void getSplitPaths(const std::string &mapPath, size_t count, std::vector<std::string> &paths) {
+	for (size_t i = 0; i < count; i ++) {
+		std::string path(mapPath);
 		path = stripExt(path);
 		path += "-";
 		path += std::to_string(i); //C++11
 		path += ".map";
+		paths.push_back(path);
+	}
+}
 
-		//Write map
-		std::ofstream output;
-		output.open(path);
-		if (!output.is_open()) {
-			std::cout << "Could not write split map, error with " << path << std::endl;
-			return 4;
+//Writes the job's exports file, if it has one, with the given split maps. Returns false if it
+//couldn't.
+bool writeExports(const MapJob &job, const std::vector<size_t> &parts, std::ostream &log) {
+	if (job.exportFile.empty()) {
+		return true;
+	}
+
+	//Export their split map to a cs file
+	std::ofstream output;
+	output.open(job.exportFile);
+	if (!output.is_open()) {
+		log << "Could not open exports file " << job.exportFile << std::endl;
+		return false;
+	}
+
+	//Mapname
+	std::string path = job.prefix + stripExt(stripPath(job.path));
+	convertPath(path);
+
+	writeInteriorExports(output, path, parts);
+	output.close();
+	return true;
+}
+
+//Runs the converter on the split maps, if there is one. Fills converted with the ones that are
+//ready to go in the exports file. Returns 0, or 7 if any failed.
+int convertSplitMaps(const Settings &settings, const std::vector<std::string> &paths, ConverterSlots &slots, std::ostream &log, SplitStats &stats, std::vector<size_t> &converted) {
+	converted.clear();
+	if (settings.converter.empty()) {
+		for (size_t i = 0; i < paths.size(); i ++) {
+			converted.push_back(i);
+		}
+		return 0;
+	}
+
+	stats.begin("convert");
+	std::vector<ConvertJob> jobs;
+	for (size_t i = 0; i < paths.size(); i ++) {
+		jobs.push_back(getConvertJob(paths[i]));
+	}
+	size_t succeeded = runConverter(settings.converter, jobs, slots);
+	for (size_t i = 0; i < jobs.size(); i ++) {
+		if (jobs[i].succeeded) {
+			converted.push_back(i);
+		} else {
+			log << "Could not convert " << jobs[i].mapPath << ", see " << jobs[i].logPath << std::endl;
+		}
+	}
+	log << "Converted " << succeeded << " of " << jobs.size() << " split maps." << std::endl;
+	return (succeeded == jobs.size() ? 0 : 7);
+}
+
+//Everything splitMapText wants for one map
+SplitOptions getSplitOptions(const Settings &settings, ThreadPool &pool, SplitStats &stats) {
+	SplitOptions options;
+	options.broadPhase = settings.broadPhase;
+	options.local = settings.local;
+	options.regions = settings.regions;
+	options.parallelColor = settings.parallelColor;
+	options.narrowPhase = settings.narrowPhase;
+	options.touchTolerance = settings.touchTolerance;
+	options.pool = &pool;
+	options.stats = &stats;
+	options.improve = settings.improve;
+	options.maxPartSize = settings.maxPartSize;
+	options.countFaces = settings.countFaces;
+	options.balance = settings.balance;
+	return options;
+}
+
+//Only worth saying when it was asked for
+void logColorsRemoved(const Settings &settings, int removed, std::ostream &log) {
+	if (settings.improve.isSet()) {
+		log << "Improving the coloring saved " << removed << " split maps." << std::endl;
+	}
+}
+
+//How it came out, when the sizes were asked for
+void logLargestPart(const Settings &settings, const Partition &parts, const std::vector<int> &faces, std::ostream &log) {
+	if (!settings.balance && settings.maxPartSize <= 0) {
+		return;
+	}
+	long largest = 0;
+	for (size_t i = 0; i < parts.getClassCount(); i ++) {
+		PartitionClass part = parts.getClass(i);
+		long size = 0;
+		for (size_t j = 0; j < part.size(); j ++) {
+			size += (settings.countFaces ? faces[part[j]] : 1);
 		}
+		largest = std::max(largest, size);
+	}
+	log << "Largest split map has " << largest << (settings.countFaces ? " faces." : " brushes.") << std::endl;
+}
+
+//Splits a map without ever having all of it in memory, see scanMapStream. Same results and return
+//codes as splitMap.
+int splitMapStream(const MapJob &job, const Settings &settings, ThreadPool &pool, ConverterSlots &slots, std::ostream &log, SplitStats &stats) {
+	const char *mapPath = job.path.c_str();
+
+	//Read the map, keeping only what collision needs
+	stats.begin("scan");
+	FILE *file = fopen(mapPath, "r");
+	//Empty files aren't maps either, same as MapFile says
+	if (file == NULL || fgetc(file) == EOF) {
+		log << "Invalid input file " << mapPath << std::endl;
+		if (file != NULL) {
+			fclose(file);
+		}
+		return 2;
+	}
+	rewind(file);
+
+	std::string headerText;
+	std::vector<MapSpan> header;
+	std::vector<MapSpan> brushes;
+	std::vector<AABB> AABBs;
+	std::vector<int> faces;
+	if (!scanMapStream(file, headerText, header, brushes, AABBs, pool, settings.countFaces ? &faces : NULL)) {
+		log << "Mismatched end brace in " << mapPath << std::endl;
+		fclose(file);
+		return 3;
+	}
+	if (ferror(file)) {
+		log << "Invalid input file " << mapPath << std::endl;
+		fclose(file);
+		return 2;
+	}
+
+	log << "Found " << brushes.size() << " brushes." << std::endl;
+	if (settings.narrowPhase) {
+		log << "The narrow phase needs the whole map in memory, so it's skipped when streaming." << std::endl;
+	}
+
+	Partition parts;
+	int removed = splitAABBs(std::move(AABBs), getSplitOptions(settings, pool, stats), parts, &faces);
+	logColorsRemoved(settings, removed, log);
+	logLargestPart(settings, parts, faces, log);
+
+	std::vector<std::string> paths;
+	getSplitPaths(job.path, parts.getClassCount(), paths);
+
+	//Write maps, reading the brushes back in as we go
+	stats.begin("write");
+	int failed = writeSplitMapsStream(file, headerText, header, brushes, parts, paths);
+	fclose(file);
+	if (failed == STREAM_MAP_CHANGED) {
+		log << "Could not write split maps, " << mapPath << " changed while it was being split" << std::endl;
+		return 4;
+	}
+	if (failed != -1) {
+		log << "Could not write split map, error with " << paths[failed] << std::endl;
+		return 4;
+	}
+
+	std::vector<size_t> converted;
+	int result = convertSplitMaps(settings, paths, slots, log, stats, converted);
+
+	stats.begin("export");
+	if (!writeExports(job, converted, log)) {
+		return 5;
+	}
+	stats.end();
+
+	return result;
+}
+
+//Splits one map. Everything it has to say goes to log, and each stage is timed in stats. Returns 0
+//if it worked, otherwise the same codes main always has.
+int splitMap(const MapJob &job, const Settings &settings, ThreadPool &pool, ConverterSlots &slots, std::ostream &log, SplitStats &stats) {
+	if (job.stream) {
+		return splitMapStream(job, settings, pool, slots, log, stats);
+	}
+
+	const char *mapPath = job.path.c_str();
+
+	//Read the map
+	stats.begin("read");
+	MapFile mapFile;
+	if (!mapFile.open(mapPath)) {
+		log << "Invalid input file " << mapPath << std::endl;
+		return 2;
+	}
 
-		output.put('{');
-		writeCstring(output, header.c_str());
+	SplitOptions options = getSplitOptions(settings, pool, stats);
 
-		//Write each brush from the set
-		for (int j = 0; colorSets[i][j] != -1; j ++) {
-			writeCstring(output, brushes[colorSets[i][j]].c_str());
-			writeCstring(output, "\r\n");
+	//Take whatever still applies from last time
+	std::string cachePath = stripExt(job.path) + ".mbcache";
+	MapCache cache;
+	if (job.cache) {
+		cache.open(cachePath.c_str());
+		options.cache = &cache;
+	}
+
+	MapSplit split;
+	if (splitMapText(mapFile.getData(), mapFile.getLength(), options, split) == SplitMismatchedBrace) {
+		log << "Mismatched end brace in " << mapPath << std::endl;
+		return 3;
+	}
+
+	log << "Found " << split.getBrushes().size() << " brushes." << std::endl;
+	if (settings.narrowPhase) {
+		log << "The narrow phase removed " << split.getEdgesRemoved() << " edges";
+		if (settings.stats != StatsNone) {
+			log << " and saved " << split.getColorsSaved() << " split maps";
+		}
+		log << "." << std::endl;
+	}
+	logColorsRemoved(settings, split.getColorsRemoved(), log);
+	logLargestPart(settings, split.getParts(), split.getFaces(), log);
+
+	if (job.cache) {
+		log << "Reused " << split.getReusedCount() << " brushes from the cache." << std::endl;
+
+		//And remember this time for next time
+		if (!cache.isValid() || cache.getMapHash() != split.getMapHash() || !cache.hasEdges(split.getEdges()) || cache.getColoringKey() != split.getColoringKey()) {
+			stats.begin("cache write");
+			cache.close();
+			if (!writeMapCache(cachePath.c_str(), split.getMapHash(), split.getHashes(), split.getAABBs(), split.getEdges(), split.getColors(), split.getColoringKey())) {
+				log << "Could not write cache " << cachePath << std::endl;
+			}
 		}
+	}
+
+	std::vector<std::string> paths;
+	getSplitPaths(job.path, split.getPartCount(), paths);
+
+	//Write maps
+	stats.begin("write");
+	int failed = writeSplitMaps(split.getData(), split.getHeader(), split.getBrushes(), split.getParts(), paths, pool);
+	if (failed != -1) {
+		log << "Could not write split map, error with " << paths[failed] << std::endl;
+		return 4;
+	}
+
+	std::vector<size_t> converted;
+	int result = convertSplitMaps(settings, paths, slots, log, stats, converted);
+
+	stats.begin("export");
+	if (!writeExports(job, converted, log)) {
+		return 5;
+	}
+	stats.end();
+
+	return result;
+}
 
-		output.put('}');
-		output.close();
+void printStats(SplitStats &stats, StatsMode mode, const std::string &mapPath, std::ostream &log) {
+	//Whatever was running when it failed still counts
+	stats.end();
+	if (mode == StatsJSON) {
+		stats.printJSON(log, mapPath);
+	} else if (mode == StatsTable) {
+		stats.printTable(log);
+	}
+}
+
+int main(int argc, const char **argv) {
+	//Make sure arguments are correct
+	if (argc < 2) {
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	MapJob defaults;
+	Settings settings;
+	if (!parseOptions(argc, argv, 2, defaults, &settings)) {
+		printUsage(argv[0]);
+		return 1;
 	}
 
-	if (argc > 3) {
-		//Export their split map to a cs file
-		std::ofstream output;
-		output.open(argv[3]);
-		if (!output.is_open()) {
-			std::cout << "Could not open exports file " << argv[3] << std::endl;
-			return 5;
+	//Work out whether we have one map or a whole batch of them
+	std::string input(argv[1]);
+	std::vector<MapJob> jobs;
+	bool batch = true;
+	if (input[0] == '@') {
+		if (!readMapList(argv[1] + 1, defaults, jobs)) {
+			return 1;
 		}
+	} else {
+		bool directory = false;
+#ifdef _WIN32
+		DWORD attributes = GetFileAttributesA(argv[1]);
+		directory = (attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY));
+#else
+		struct stat info;
+		directory = (stat(argv[1], &info) == 0 && S_ISDIR(info.st_mode));
+#endif
+		if (directory || input.find_first_of("*?[") != std::string::npos) {
+			std::vector<std::string> maps;
+			listMaps(input, directory, maps);
+			if (maps.empty()) {
+				std::cout << "No maps found in " << input << std::endl;
+				return 2;
+			}
 
-		//Mapname
-		std::string path;
-		if (argc > 5) {
-			path = std::string(argv[5]);
-			path += stripExt(stripPath(argv[1]));
+			//Each map gets its own exports file in the -e directory
+			for (size_t i = 0; i < maps.size(); i ++) {
+				MapJob job = defaults;
+				job.path = maps[i];
+				if (!defaults.exportFile.empty()) {
+					job.exportFile = getBatchExportFile(defaults.exportFile, maps[i]);
+				}
+				jobs.push_back(job);
+			}
 		} else {
-			path = stripExt(stripPath(argv[1]));
+			batch = false;
+			defaults.path = input;
+			jobs.push_back(defaults);
 		}
-		convertPath(path);
-
-		for (int i = 0; colorSets[i] != NULL; i ++) {
-			writeCstring(output, "   new InteriorInstance() {\n"
-			                     "      position = \"0 0 0\";\n"
-			                     "      rotation = \"1 0 0 0\";\n"
-			                     "      scale = \"1 1 1\";\n");
-
-			//   interiorFile = "<path/to/>Mapname-0.dif";
-			writeCstring(output, "      interiorFile = \"");
-			writeCstring(output, path.c_str());
-			writeCstring(output, "-");
-			writeCstring(output, std::to_string(i).c_str());
-			writeCstring(output, ".dif\";\n");
-			writeCstring(output, "      showTerrainInside = \"1\";\n");
-			writeCstring(output, "   };\n");
+	}
+
+	ThreadPool pool(settings.threads);
+	ConverterSlots slots(settings.converterJobs);
+
+	if (!batch) {
+		SplitStats stats(settings.stats != StatsNone);
+		int result = splitMap(jobs[0], settings, pool, slots, std::cout, stats);
+		printStats(stats, settings.stats, jobs[0].path, std::cout);
+		return result;
+	}
+
+	//Every map is a task of its own, and each one splits its own work up further. Threads that run
+	//out of maps steal from the big ones still going. Output is held back until a map is done so
+	//maps don't talk over each other.
+	std::vector<int> results(jobs.size(), 0);
+	std::mutex printLock;
+	auto splitJobs = [&jobs, &results, &printLock, &settings, &pool, &slots](size_t begin, size_t end, int) {
+		for (size_t i = begin; i < end; i ++) {
+			std::ostringstream log;
+			SplitStats stats(settings.stats != StatsNone);
+			results[i] = splitMap(jobs[i], settings, pool, slots, log, stats);
+			printStats(stats, settings.stats, jobs[i].path, log);
+
+			std::lock_guard<std::mutex> guard(printLock);
+			std::cout << log.str() << jobs[i].path << (results[i] == 0 ? ": done" : ": failed") << std::endl;
 		}
-		output.close();
+	};
+	if (settings.stats == StatsNone) {
+		pool.parallelFor(jobs.size(), 1, splitJobs);
+	} else {
+		//Stats are for the whole process, so only one map at a time or they'd all be mixed up
+		splitJobs(0, jobs.size(), 0);
 	}
+
+	size_t succeeded = std::count(results.begin(), results.end(), 0);
+	std::cout << "Split " << succeeded << " of " << jobs.size() << " maps." << std::endl;
+	return (succeeded == jobs.size() ? 0 : 6);
 }
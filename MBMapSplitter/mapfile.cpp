@@ -0,0 +1,683 @@
+//
+//  mapfile.cpp
+//  MBMapSplitter
+//
+//  Copyright (c) 2015 HiGuy Smith
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#include "mapfile.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+#endif
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+MapFile::MapFile() : data(NULL), length(0), mapping(NULL) {
+
+}
+
+MapFile::~MapFile() {
+	close();
+}
+
+bool MapFile::open(const char *path, bool binary) {
+	close();
+
+#ifdef _WIN32
+	//No mmap here, just read it like we always have
+	std::ifstream stream;
+	stream.open(path, binary ? std::ios::in | std::ios::binary : std::ios::in);
+
+	if (!stream.is_open()) {
+		return false;
+	}
+	if (binary) {
+		buffer.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+		stream.close();
+		data = buffer.data();
+		length = buffer.length();
+		return length > 0;
+	}
+	std::string line;
+	while (getline(stream, line, '\n')) {
+		buffer.append(line);
+		buffer.append("\n");
+	}
+	stream.close();
+
+	data = buffer.data();
+	length = buffer.length();
+#else
+	//Mapped, the bytes come through as they are whether it's binary or not
+	(void)binary;
+	int fd = ::open(path, O_RDONLY);
+	if (fd == -1) {
+		return false;
+	}
+	struct stat info;
+	if (fstat(fd, &info) == -1 || info.st_size == 0) {
+		::close(fd);
+		return false;
+	}
+
+	void *map = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	//The mapping keeps the file around, we don't need the descriptor
+	::close(fd);
+	if (map == MAP_FAILED) {
+		return false;
+	}
+	//We only ever read front to back
+	madvise(map, (size_t)info.st_size, MADV_SEQUENTIAL);
+
+	mapping = map;
+	data = (const char *)map;
+	length = (size_t)info.st_size;
+#endif
+
+	return length > 0;
+}
+
+void MapFile::close() {
+#ifndef _WIN32
+	if (mapping != NULL) {
+		munmap(mapping, length);
+	}
+#endif
+	mapping = NULL;
+	buffer.clear();
+	data = NULL;
+	length = 0;
+}
+
+bool tokenizeMap(const char *data, size_t length, std::vector<MapSpan> &header, std::vector<MapSpan> &brushes) {
+	int inGroups = 0;
+	bool foundHeader = false;
+
+	//Where the current header piece / brush started. Anything nested inside a brush restarts the
+	//brush after it closes, which is how the old copying loop behaved too.
+	size_t headerStart = 0;
+	size_t brushStart = 0;
+
+	for (size_t i = 0; i < length; i ++) {
+		char cur = data[i];
+		if (cur == '{') {
+			//Header pieces end before any brace
+			if (inGroups == 1 && !foundHeader && i > headerStart) {
+				MapSpan span = {headerStart, i - headerStart};
+				header.push_back(span);
+			}
+			inGroups ++;
+
+			//Worldspawn group start
+			if (inGroups == 1) {
+				headerStart = i + 1;
+				continue;
+			}
+
+			foundHeader = true;
+
+			if (inGroups == 2) {
+				brushStart = i;
+			}
+		}
+		if (cur == '}') {
+			inGroups --;
+			if (inGroups < 0) {
+				return false;
+			}
+			//The header takes the closing brace of its group too
+			if (inGroups == 0 && !foundHeader) {
+				MapSpan span = {headerStart, i + 1 - headerStart};
+				header.push_back(span);
+			}
+			//Back out of something nested, the brush picks up after it
+			if (inGroups == 2) {
+				brushStart = i + 1;
+			}
+			//End of brush
+			if (inGroups == 1) {
+				MapSpan span = {brushStart, i + 1 - brushStart};
+				brushes.push_back(span);
+			}
+		}
+	}
+
+	//Map ended inside the header
+	if (inGroups >= 1 && !foundHeader && length > headerStart) {
+		MapSpan span = {headerStart, length - headerStart};
+		header.push_back(span);
+	}
+
+	return true;
+}
+
+//Whitespace as far as the old stringstream tokenizing was concerned
+static inline bool isSpace(char c) {
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+//Reads the first three numbers of a vertex (the text between its parens) in place. Each is read
+//like atof() would read the whole token. Returns false if there aren't three.
+static inline bool readVertex(const char *start, const char *end, double *coords) {
+	const char *cur = start;
+	for (int i = 0; i < 3; i ++) {
+		while (cur < end && isSpace(*cur)) {
+			cur ++;
+		}
+		if (cur == end) {
+			return false;
+		}
+		//Numbers can't contain spaces or parens, so strtod stops inside the token
+		char *parsed;
+		coords[i] = strtod(cur, &parsed);
+		if (parsed == cur) {
+			coords[i] = 0.0;
+		}
+		while (cur < end && !isSpace(*cur)) {
+			cur ++;
+		}
+	}
+	return true;
+}
+
+AABB getBrushAABB(const char *input, size_t length) {
+	const char *end = input + length;
+
+#ifdef __SSE2__
+	//minpd/maxpd give back the second operand unless the first wins outright, same as MIN/MAX
+	__m128d minXY = _mm_set1_pd(INT_MAX), minZ = _mm_set1_pd(INT_MAX);
+	__m128d maxXY = _mm_set1_pd(INT_MIN), maxZ = _mm_set1_pd(INT_MIN);
+#else
+	double aabb[6];
+	aabb[0] = INT_MAX;
+	aabb[1] = INT_MAX;
+	aabb[2] = INT_MAX;
+	aabb[3] = INT_MIN;
+	aabb[4] = INT_MIN;
+	aabb[5] = INT_MIN;
+#endif
+
+	//Find all points within (), straight out of the text
+	const char *cur = input;
+	while (cur < end) {
+		const char *open = (const char *)memchr(cur, '(', end - cur);
+		if (open == NULL) {
+			break;
+		}
+		//A second ( before the ) starts the vertex over
+		const char *vert = open + 1;
+		const char *close = vert;
+		while (close < end && *close != ')') {
+			if (*close == '(') {
+				vert = close + 1;
+			}
+			close ++;
+		}
+		if (close == end) {
+			break;
+		}
+		cur = close + 1;
+
+		double coords[3];
+		if (!readVertex(vert, close, coords)) {
+			continue;
+		}
+
+#ifdef __SSE2__
+		__m128d xy = _mm_loadu_pd(coords);
+		__m128d z = _mm_load_sd(coords + 2);
+		minXY = _mm_min_pd(minXY, xy);
+		maxXY = _mm_max_pd(maxXY, xy);
+		minZ = _mm_min_sd(minZ, z);
+		maxZ = _mm_max_sd(maxZ, z);
+#else
+		aabb[0] = MIN(aabb[0], coords[0]);
+		aabb[1] = MIN(aabb[1], coords[1]);
+		aabb[2] = MIN(aabb[2], coords[2]);
+		aabb[3] = MAX(aabb[3], coords[0]);
+		aabb[4] = MAX(aabb[4], coords[1]);
+		aabb[5] = MAX(aabb[5], coords[2]);
+#endif
+	}
+
+#ifdef __SSE2__
+	double aabb[6];
+	_mm_storeu_pd(aabb, minXY);
+	_mm_store_sd(aabb + 2, minZ);
+	_mm_storeu_pd(aabb + 3, maxXY);
+	_mm_store_sd(aabb + 5, maxZ);
+#endif
+
+	return AABB(aabb[0], aabb[1], aabb[2], aabb[3], aabb[4], aabb[5]);
+}
+
+void getBrushAABBs(const char *data, const std::vector<MapSpan> &brushes, std::vector<AABB> &AABBs, ThreadPool &pool) {
+	//Every brush gets its own slot up front, so it doesn't matter who finishes first
+	AABBs.assign(brushes.size(), AABB(0, 0, 0, 0, 0, 0));
+
+	pool.parallelFor(brushes.size(), 1024, [data, &brushes, &AABBs](size_t begin, size_t end, int) {
+		for (size_t i = begin; i < end; i ++) {
+			AABBs[i] = getBrushAABB(data + brushes[i].offset, brushes[i].length);
+		}
+	});
+}
+
+int countBrushFaces(const char *input, size_t length) {
+	int faces = 0;
+	bool lineStart = true;
+	for (size_t i = 0; i < length; i ++) {
+		char cur = input[i];
+		if (cur == '\n') {
+			lineStart = true;
+		} else if (lineStart && cur != ' ' && cur != '\t' && cur != '\r') {
+			faces += (cur == '(');
+			lineStart = false;
+		}
+	}
+	return faces;
+}
+
+int getBrushPlanePoints(const char *input, size_t length, std::vector<double> &points) {
+	points.clear();
+	const char *end = input + length;
+	const char *cur = input;
+	while (cur < end) {
+		const char *lineEnd = (const char *)memchr(cur, '\n', end - cur);
+		if (lineEnd == NULL) {
+			lineEnd = end;
+		}
+		while (cur < lineEnd && (*cur == ' ' || *cur == '\t' || *cur == '\r')) {
+			cur ++;
+		}
+		if (cur < lineEnd && *cur == '(') {
+			//Same vertex rules as getBrushAABB, but only the first three on the line
+			double face[9];
+			int found = 0;
+			while (found < 3 && cur < lineEnd) {
+				const char *open = (const char *)memchr(cur, '(', lineEnd - cur);
+				if (open == NULL) {
+					break;
+				}
+				const char *vert = open + 1;
+				const char *close = vert;
+				while (close < lineEnd && *close != ')') {
+					if (*close == '(') {
+						vert = close + 1;
+					}
+					close ++;
+				}
+				if (close == lineEnd) {
+					break;
+				}
+				cur = close + 1;
+				if (readVertex(vert, close, face + found * 3)) {
+					found ++;
+				}
+			}
+			if (found == 3) {
+				points.insert(points.end(), face, face + 9);
+			}
+		}
+		cur = (lineEnd < end ? lineEnd + 1 : end);
+	}
+	return (int)(points.size() / 9);
+}
+
+void getBrushFaces(const char *data, const std::vector<MapSpan> &brushes, std::vector<int> &faces, ThreadPool &pool) {
+	faces.assign(brushes.size(), 0);
+
+	pool.parallelFor(brushes.size(), 1024, [data, &brushes, &faces](size_t begin, size_t end, int) {
+		for (size_t i = begin; i < end; i ++) {
+			faces[i] = countBrushFaces(data + brushes[i].offset, brushes[i].length);
+		}
+	});
+}
+
+//How big a split map will be, so it can be written in one go
+static size_t getSplitMapSize(const std::vector<MapSpan> &header, const std::vector<MapSpan> &brushes, const PartitionClass &set) {
+	size_t size = 2; //Braces
+	for (size_t i = 0; i < header.size(); i ++) {
+		size += header[i].length;
+	}
+	for (size_t i = 0; i < set.size(); i ++) {
+		size += brushes[set[i]].length + 2; //And its "\r\n"
+	}
+	return size;
+}
+
+static bool writeSplitMap(const std::string &path, const char *data, const std::vector<MapSpan> &header, const std::vector<MapSpan> &brushes, const PartitionClass &set) {
+	size_t size = getSplitMapSize(header, brushes, set);
+
+#ifdef _WIN32
+	//Put the whole file together first. The stream is in text mode like it always was, so line
+	//endings come out the same as before.
+	std::string buffer;
+	buffer.reserve(size);
+	buffer.push_back('{');
+	for (size_t i = 0; i < header.size(); i ++) {
+		buffer.append(data + header[i].offset, header[i].length);
+	}
+	for (size_t i = 0; i < set.size(); i ++) {
+		buffer.append(data + brushes[set[i]].offset, brushes[set[i]].length);
+		buffer.append("\r\n", 2);
+	}
+	buffer.push_back('}');
+
+	std::ofstream output;
+	output.open(path);
+	if (!output.is_open()) {
+		return false;
+	}
+	output.write(buffer.data(), buffer.size());
+	output.close();
+	return !output.fail();
+#else
+	//Gather the pieces straight out of the map text and hand them over all at once
+	static const char lineEnd[] = "\r\n";
+	std::vector<struct iovec> pieces;
+	pieces.reserve(header.size() + 2 * set.size() + 2);
+
+	struct iovec piece;
+	piece.iov_base = (void *)"{";
+	piece.iov_len = 1;
+	pieces.push_back(piece);
+	for (size_t i = 0; i < header.size(); i ++) {
+		piece.iov_base = (void *)(data + header[i].offset);
+		piece.iov_len = header[i].length;
+		pieces.push_back(piece);
+	}
+	for (size_t i = 0; i < set.size(); i ++) {
+		piece.iov_base = (void *)(data + brushes[set[i]].offset);
+		piece.iov_len = brushes[set[i]].length;
+		pieces.push_back(piece);
+		piece.iov_base = (void *)lineEnd;
+		piece.iov_len = 2;
+		pieces.push_back(piece);
+	}
+	piece.iov_base = (void *)"}";
+	piece.iov_len = 1;
+	pieces.push_back(piece);
+
+	int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (fd == -1) {
+		return false;
+	}
+
+	size_t written = 0;
+	size_t next = 0;
+	while (next < pieces.size()) {
+		int count = (int)std::min(pieces.size() - next, (size_t)IOV_MAX);
+		ssize_t result = writev(fd, &pieces[next], count);
+		if (result == -1 && errno == EINTR) {
+			continue;
+		}
+		//Nothing going out means nothing ever will (written can't add up to size, so it fails)
+		if (result <= 0) {
+			break;
+		}
+		written += (size_t)result;
+
+		//Skip whatever made it out, which can stop partway through a piece
+		size_t done = (size_t)result;
+		while (next < pieces.size() && done >= pieces[next].iov_len) {
+			done -= pieces[next].iov_len;
+			next ++;
+		}
+		if (done > 0) {
+			pieces[next].iov_base = (char *)pieces[next].iov_base + done;
+			pieces[next].iov_len -= done;
+		}
+	}
+
+	if (::close(fd) == -1) {
+		return false;
+	}
+	return written == size;
+#endif
+}
+
+int writeSplitMaps(const char *data, const std::vector<MapSpan> &header, const std::vector<MapSpan> &brushes, const Partition &colorSets, const std::vector<std::string> &paths, ThreadPool &pool) {
+	//Each file is its own job, they have nothing to share
+	std::vector<char> written(paths.size(), 0);
+	pool.parallelFor(paths.size(), 1, [data, &header, &brushes, &colorSets, &paths, &written](size_t begin, size_t end, int) {
+		for (size_t i = begin; i < end; i ++) {
+			written[i] = writeSplitMap(paths[i], data, header, brushes, colorSets.getClass(i));
+		}
+	});
+
+	for (size_t i = 0; i < paths.size(); i ++) {
+		if (!written[i]) {
+			return (int)i;
+		}
+	}
+	return -1;
+}
+
+//How much of the map to read at a time when streaming
+#define STREAM_CHUNK_SIZE (4 << 20)
+
+bool scanMapStream(FILE *file, std::string &headerText, std::vector<MapSpan> &header, std::vector<MapSpan> &brushes, std::vector<AABB> &AABBs, ThreadPool &pool, std::vector<int> *faces) {
+	//Same as tokenizeMap, only offsets are into the whole file
+	int inGroups = 0;
+	bool foundHeader = false;
+	size_t headerStart = 0;
+	size_t brushStart = 0;
+
+	//The buffer holds the file from bufferStart on: the unfinished header or brush from last time,
+	//then the new chunk
+	std::vector<char> buffer;
+	size_t bufferStart = 0;
+	size_t position = 0;
+	std::vector<MapSpan> finished;
+
+	while (true) {
+		size_t keepFrom = position;
+		if (inGroups >= 1 && !foundHeader) {
+			keepFrom = MIN(keepFrom, headerStart);
+		}
+		if (inGroups >= 2) {
+			keepFrom = MIN(keepFrom, brushStart);
+		}
+		buffer.erase(buffer.begin(), buffer.begin() + (keepFrom - bufferStart));
+		bufferStart = keepFrom;
+
+		size_t kept = buffer.size();
+		buffer.resize(kept + STREAM_CHUNK_SIZE);
+		size_t read = fread(buffer.data() + kept, 1, STREAM_CHUNK_SIZE, file);
+		buffer.resize(kept + read);
+		if (read == 0) {
+			break;
+		}
+
+		finished.clear();
+		for (size_t j = kept; j < kept + read; j ++) {
+			size_t i = bufferStart + j;
+			char cur = buffer[j];
+			if (cur == '{') {
+				if (inGroups == 1 && !foundHeader && i > headerStart) {
+					MapSpan span = {headerText.size(), i - headerStart};
+					headerText.append(buffer.data() + (headerStart - bufferStart), span.length);
+					header.push_back(span);
+				}
+				inGroups ++;
+
+				if (inGroups == 1) {
+					headerStart = i + 1;
+					continue;
+				}
+
+				foundHeader = true;
+
+				if (inGroups == 2) {
+					brushStart = i;
+				}
+			}
+			if (cur == '}') {
+				inGroups --;
+				if (inGroups < 0) {
+					return false;
+				}
+				if (inGroups == 0 && !foundHeader) {
+					MapSpan span = {headerText.size(), i + 1 - headerStart};
+					headerText.append(buffer.data() + (headerStart - bufferStart), span.length);
+					header.push_back(span);
+				}
+				if (inGroups == 2) {
+					brushStart = i + 1;
+				}
+				if (inGroups == 1) {
+					MapSpan span = {brushStart, i + 1 - brushStart};
+					brushes.push_back(span);
+					MapSpan inBuffer = {brushStart - bufferStart, span.length};
+					finished.push_back(inBuffer);
+				}
+			}
+		}
+		position = bufferStart + buffer.size();
+
+		//Bounds of everything that finished in this chunk, while it's still here
+		size_t first = AABBs.size();
+		AABBs.resize(first + finished.size(), AABB(0, 0, 0, 0, 0, 0));
+		const char *data = buffer.data();
+		pool.parallelFor(finished.size(), 1024, [data, &finished, &AABBs, first](size_t begin, size_t end, int) {
+			for (size_t i = begin; i < end; i ++) {
+				AABBs[first + i] = getBrushAABB(data + finished[i].offset, finished[i].length);
+			}
+		});
+		if (faces != NULL) {
+			faces->resize(first + finished.size(), 0);
+			int *brushFaces = faces->data() + first;
+			pool.parallelFor(finished.size(), 1024, [data, &finished, brushFaces](size_t begin, size_t end, int) {
+				for (size_t i = begin; i < end; i ++) {
+					brushFaces[i] = countBrushFaces(data + finished[i].offset, finished[i].length);
+				}
+			});
+		}
+	}
+
+	//Map ended inside the header
+	if (inGroups >= 1 && !foundHeader && position > headerStart) {
+		MapSpan span = {headerText.size(), position - headerStart};
+		headerText.append(buffer.data() + (headerStart - bufferStart), span.length);
+		header.push_back(span);
+	}
+
+	return true;
+}
+
+int writeSplitMapsStream(FILE *file, const std::string &headerText, const std::vector<MapSpan> &header, const std::vector<MapSpan> &brushes, const Partition &colorSets, const std::vector<std::string> &paths) {
+	std::vector<int> setOf(brushes.size(), -1);
+	for (size_t i = 0; i < colorSets.getClassCount(); i ++) {
+		PartitionClass set = colorSets.getClass(i);
+		for (size_t j = 0; j < set.size(); j ++) {
+			setOf[set[j]] = (int)i;
+		}
+	}
+
+	//Text mode, same as the map was read in, so line endings come out like they do from
+	//writeSplitMaps everywhere
+	std::vector<FILE *> outputs(paths.size(), (FILE *)NULL);
+	int failed = -1;
+	for (size_t i = 0; i < paths.size(); i ++) {
+		outputs[i] = fopen(paths[i].c_str(), "w");
+		if (outputs[i] == NULL) {
+			failed = (int)i;
+			break;
+		}
+		setvbuf(outputs[i], NULL, _IOFBF, 1 << 18);
+		fputc('{', outputs[i]);
+		for (size_t j = 0; j < header.size(); j ++) {
+			fwrite(headerText.data() + header[j].offset, 1, header[j].length, outputs[i]);
+		}
+	}
+
+	if (failed == -1) {
+		rewind(file);
+		std::vector<char> buffer(STREAM_CHUNK_SIZE);
+		size_t bufferStart = 0;
+		size_t brush = 0;
+		while (brush < brushes.size()) {
+			size_t read = fread(buffer.data(), 1, buffer.size(), file);
+			if (read == 0) {
+				break;
+			}
+			size_t bufferEnd = bufferStart + read;
+
+			//Copy out everything in this chunk, up to a brush that carries on into the next one
+			while (brush < brushes.size()) {
+				const MapSpan &span = brushes[brush];
+				size_t start = MAX(span.offset, bufferStart);
+				size_t end = MIN(span.offset + span.length, bufferEnd);
+				if (start >= bufferEnd) {
+					break;
+				}
+				FILE *output = outputs[setOf[brush]];
+				fwrite(buffer.data() + (start - bufferStart), 1, end - start, output);
+				if (end < span.offset + span.length) {
+					break;
+				}
+				fwrite("\r\n", 1, 2, output);
+				brush ++;
+			}
+			bufferStart = bufferEnd;
+		}
+
+		//The map got shorter since the first pass, so none of these are right
+		if (brush < brushes.size()) {
+			failed = STREAM_MAP_CHANGED;
+		}
+	}
+
+	for (size_t i = 0; i < outputs.size(); i ++) {
+		if (outputs[i] == NULL) {
+			continue;
+		}
+		fputc('}', outputs[i]);
+		bool error = (ferror(outputs[i]) != 0);
+		if (fclose(outputs[i]) != 0 || error) {
+			if (failed == -1 || (failed >= 0 && (int)i < failed)) {
+				failed = (int)i;
+			}
+		}
+	}
+	return failed;
+}
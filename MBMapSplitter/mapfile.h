@@ -0,0 +1,112 @@
+//
+//  mapfile.h
+//  MBMapSplitter
+//
+//  Copyright (c) 2015 HiGuy Smith
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#ifndef __MBMapSplitter__mapfile__
+#define __MBMapSplitter__mapfile__
+
+#include <stddef.h>
+#include <stdio.h>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "aabbcolor.h"
+#include "threadpool.h"
+
+//A piece of the map text, given as where it starts and how long it is
+struct MapSpan {
+	size_t offset;
+	size_t length;
+};
+
+//A map file, read-only. The file is mapped into memory rather than read, so the text is only
+//ever in memory once and everything else just points into it.
+class MapFile {
+	const char *data;
+	size_t length;
+	void *mapping;
+	std::string buffer;
+
+	MapFile(const MapFile &other) = delete;
+	MapFile &operator=(const MapFile &other) = delete;
+public:
+	MapFile();
+	~MapFile();
+
+	//Binary files are read as they are on Windows, rather than line by line
+	bool open(const char *path, bool binary = false);
+	void close();
+
+	const char *getData() const { return data; }
+	size_t getLength() const { return length; }
+};
+
+//Splits the map text into the worldspawn header (the text before its first brush, usually in one
+//piece) and the brushes, braces included. Returns false if there's an unmatched end brace.
+bool tokenizeMap(const char *data, size_t length, std::vector<MapSpan> &header, std::vector<MapSpan> &brushes);
+
+//Finds the bounds of all the points in a brush
+AABB getBrushAABB(const char *input, size_t length);
+
+//Finds the bounds of every brush, spread over the pool. AABBs[i] always belongs to brushes[i].
+void getBrushAABBs(const char *data, const std::vector<MapSpan> &brushes, std::vector<AABB> &AABBs, ThreadPool &pool);
+
+//How many faces a brush has: one per line that starts with a '(', which is how every plane is
+//written out. Gives an idea of how much work the brush is for map2dif.
+int countBrushFaces(const char *input, size_t length);
+
+//Reads the plane of every face in a brush: the first three points on each line that starts with
+//a '(', nine numbers a face, into points. Returns how many faces there were.
+int getBrushPlanePoints(const char *input, size_t length, std::vector<double> &points);
+
+//Counts every brush's faces, spread over the pool. faces[i] always belongs to brushes[i].
+void getBrushFaces(const char *data, const std::vector<MapSpan> &brushes, std::vector<int> &faces, ThreadPool &pool);
+
+//Writes one split map per color set, all at the same time on the pool. Set i goes to paths[i] and
+//gets a '{', the header, each of its brushes followed by "\r\n", and a '}'. Returns the index of
+//the first set that couldn't be written, or -1 if they all were.
+int writeSplitMaps(const char *data, const std::vector<MapSpan> &header, const std::vector<MapSpan> &brushes, const Partition &colorSets, const std::vector<std::string> &paths, ThreadPool &pool);
+
+//Streaming, for maps too big to keep in memory. The first pass reads the map a chunk at a time and
+//keeps only the header text and each brush's span and AABB. The second pass reads it through
+//again and copies each brush into its split map as it goes by. Memory goes with the brush count,
+//not the size of the file.
+
+//Does what tokenizeMap and getBrushAABBs do, reading from file, and getBrushFaces too unless faces
+//is NULL. Header spans are into headerText, brush spans are file offsets. Returns false if there's
+//an unmatched end brace; check ferror() afterwards for read errors.
+bool scanMapStream(FILE *file, std::string &headerText, std::vector<MapSpan> &header, std::vector<MapSpan> &brushes, std::vector<AABB> &AABBs, ThreadPool &pool, std::vector<int> *faces = NULL);
+
+//Writes the same split maps writeSplitMaps would, reading the brushes from file from the start.
+//All the split maps are written at once, in one pass. Returns the index of the first one that
+//couldn't be written, -1 if they all were, or STREAM_MAP_CHANGED if the map was shorter than
+//it was when it was scanned (then none of them are right).
+#define STREAM_MAP_CHANGED -2
+int writeSplitMapsStream(FILE *file, const std::string &headerText, const std::vector<MapSpan> &header, const std::vector<MapSpan> &brushes, const Partition &colorSets, const std::vector<std::string> &paths);
+
+//Writes out a piece of the map
+inline void writeSpan(std::ostream &stream, const char *data, const MapSpan &span) {
+	stream.write(data + span.offset, span.length);
+}
+
+#endif
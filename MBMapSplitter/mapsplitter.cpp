@@ -0,0 +1,382 @@
+//
+//  mapsplitter.cpp
+//  MBMapSplitter
+//
+//  Copyright (c) 2015 HiGuy Smith
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#include "mapsplitter.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include "broadphase.h"
+#include "narrowphase.h"
+
+MapSplit::MapSplit() : data(NULL), mapHash(0), coloringKey(0), reusedCount(0), colorsRemoved(0), edgesRemoved(0), colorsSaved(0) {
+
+}
+
+void MapSplit::forEachPiece(size_t i, const std::function<void(const char *, size_t)> &callback) const {
+	callback("{", 1);
+	for (size_t j = 0; j < header.size(); j ++) {
+		callback(data + header[j].offset, header[j].length);
+	}
+	PartitionClass part = parts.getClass(i);
+	for (size_t j = 0; j < part.size(); j ++) {
+		callback(data + brushes[part[j]].offset, brushes[part[j]].length);
+		callback("\r\n", 2);
+	}
+	callback("}", 1);
+}
+
+size_t MapSplit::getPartLength(size_t i) const {
+	size_t length = 2; //Braces
+	for (size_t j = 0; j < header.size(); j ++) {
+		length += header[j].length;
+	}
+	PartitionClass part = parts.getClass(i);
+	for (size_t j = 0; j < part.size(); j ++) {
+		length += brushes[part[j]].length + 2; //And its "\r\n"
+	}
+	return length;
+}
+
+void MapSplit::getPartText(size_t i, std::string &text) const {
+	text.clear();
+	text.reserve(getPartLength(i));
+	forEachPiece(i, [&text](const char *piece, size_t length) {
+		text.append(piece, length);
+	});
+}
+
+//Takes the color sets out of a colored graph, for everyone that comes after
+static void getParts(Graph &graph, size_t count, SplitStats &stats, Partition &parts) {
+	stats.begin("sets");
+	parts = graph.getPartition();
+
+	if (stats.isEnabled()) {
+		int maxDegree = 0;
+		for (size_t i = 0; i < count; i ++) {
+			maxDegree = std::max(maxDegree, graph.findNode((int)i)->getDegree());
+		}
+		stats.setGraph(count, graph.getEdgeCount(), maxDegree, (int)parts.getClassCount());
+
+		//Bounds of each split map
+		std::vector<double> volumes;
+		for (size_t i = 0; i < parts.getClassCount(); i ++) {
+			PartitionClass part = parts.getClass(i);
+			double low[3] = {0, 0, 0}, high[3] = {0, 0, 0};
+			for (size_t j = 0; j < part.size(); j ++) {
+				AABB box(0, 0, 0, 0, 0, 0);
+				graph.getBox(part[j], box);
+				for (int axis = 0; axis < 3; axis ++) {
+					low[axis] = (j == 0 ? box.getMin(axis) : std::min(low[axis], box.getMin(axis)));
+					high[axis] = (j == 0 ? box.getMax(axis) : std::max(high[axis], box.getMax(axis)));
+				}
+			}
+			volumes.push_back((high[0] - low[0]) * (high[1] - low[1]) * (high[2] - low[2]));
+		}
+		stats.setSplitVolumes(volumes);
+	}
+	stats.end();
+}
+
+//Without a pool, a pool of one runs everything right here
+static ThreadPool *getPool(const SplitOptions &options, std::unique_ptr<ThreadPool> &ownPool) {
+	if (options.pool != NULL) {
+		return options.pool;
+	}
+	ownPool.reset(new ThreadPool(1));
+	return ownPool.get();
+}
+
+//How many colors a colored graph uses
+static int countColors(Graph &graph, size_t count) {
+	int colors = 0;
+	for (size_t i = 0; i < count; i ++) {
+		colors = std::max(colors, graph.findNode((int)i)->getColor() + 1);
+	}
+	return colors;
+}
+
+//DSATUR (a component at a time), the locality-aware kind or the parallel kind. Regions need the
+//AABBs, which the graph has by now, and are kept in regions for improving and balancing within.
+//Locality wins over parallel, it has to go one brush at a time. Returns how many colors it used.
+static int colorGraph(Graph &graph, size_t count, const SplitOptions &options, ThreadPool *pool, std::vector<int> &regions) {
+	regions.clear();
+	if (!options.local && options.regions <= 1) {
+		if (options.parallelColor) {
+			graph.colorParallel(pool, options.improve.seed);
+		} else {
+			graph.colorComponents(pool);
+		}
+		return countColors(graph, count);
+	}
+	if (options.regions > 1) {
+		std::vector<AABB> AABBs(count, AABB(0, 0, 0, 0, 0, 0));
+		for (size_t i = 0; i < count; i ++) {
+			graph.getBox((int)i, AABBs[i]);
+		}
+		getRegions(AABBs, options.regions, regions);
+	}
+	graph.colorDSATURLocal(regions.empty() ? NULL : &regions);
+	return countColors(graph, count);
+}
+
+//Colors a throwaway graph of these AABBs and edges the same way, for comparing against
+static int colorCopy(std::vector<AABB> &AABBs, const std::vector<std::pair<int, int> > &pairs, const SplitOptions &options, ThreadPool *pool) {
+	Graph graph(AABBs, pairs);
+	std::vector<int> regions;
+	return colorGraph(graph, AABBs.size(), options, pool, regions);
+}
+
+//Whether to work out how many colors the narrow phase saved. It takes another coloring, so only
+//when someone's going to look at it.
+static bool isCountingColorsSaved(const SplitOptions &options, SplitStats &stats) {
+	return options.narrowPhase && (options.countColorsSaved || stats.isEnabled());
+}
+
+//Looks for fewer colors if asked to, see improveColoring. Never across regions.
+static int improveColors(Graph &graph, const SplitOptions &options, const std::vector<int> &regions, SplitStats &stats) {
+	if (!options.improve.isSet()) {
+		return 0;
+	}
+	stats.begin("improve");
+	return graph.improveColoring(options.improve, regions.empty() ? NULL : &regions);
+}
+
+//Evens out the split maps if asked to, see balanceColoring. Never across regions either.
+static void balanceColors(Graph &graph, const SplitOptions &options, const std::vector<int> *faces, const std::vector<int> &regions, SplitStats &stats) {
+	if (!options.balance && options.maxPartSize <= 0) {
+		return;
+	}
+	stats.begin("balance");
+	graph.balanceColoring(options.countFaces ? faces : NULL, options.maxPartSize, regions.empty() ? NULL : &regions);
+}
+
+//Drops the pairs whose brushes don't really touch, see refineOverlaps. When counting what that
+//saves, broadColors gets how many colors the graph would have needed with them, colored the way
+//this run colors.
+static void refineEdges(const char *data, const std::vector<MapSpan> &brushes, std::vector<AABB> &AABBs, std::vector<std::pair<int, int> > &pairs, const SplitOptions &options, ThreadPool *pool, SplitStats &stats, size_t &edgesRemoved, int &broadColors) {
+	stats.begin("narrow");
+	if (isCountingColorsSaved(options, stats)) {
+		broadColors = colorCopy(AABBs, pairs, options, pool);
+	}
+	edgesRemoved = refineOverlaps(data, brushes, pairs, options.touchTolerance, pool);
+}
+
+uint64_t getColoringKey(const SplitOptions &options, std::vector<AABB> &AABBs, const std::vector<int> &faces, const std::vector<std::pair<int, int> > &refined) {
+	bool improve = options.improve.isSet();
+	if (!options.balance && options.maxPartSize <= 0 && !options.local && options.regions <= 1 && !options.parallelColor && !options.narrowPhase && !improve) {
+		return 0;
+	}
+	int64_t settings[12] = {options.maxPartSize, options.countFaces ? 1 : 0, options.balance ? 1 : 0, options.local ? 1 : 0, options.regions, options.parallelColor ? 1 : 0, (options.parallelColor || improve) ? options.improve.seed : 0, options.narrowPhase ? 1 : 0, 0, improve ? 1 : 0, improve ? options.improve.steps : 0, 0};
+	if (options.narrowPhase) {
+		memcpy(&settings[8], &options.touchTolerance, sizeof(double));
+	}
+	if (improve) {
+		memcpy(&settings[11], &options.improve.seconds, sizeof(double));
+	}
+	uint64_t key = hashBytes((const char *)settings, sizeof(settings));
+
+	//Face counts can change without the edges changing, and balancing goes by them
+	if (options.countFaces && (options.balance || options.maxPartSize > 0) && !faces.empty()) {
+		key = hashBytes((const char *)&faces[0], faces.size() * sizeof(int), key);
+	}
+	//So do the boxes, and where they are is what locality and regions go by
+	if (options.local || options.regions > 1) {
+		for (size_t i = 0; i < AABBs.size(); i ++) {
+			double bounds[6];
+			for (int axis = 0; axis < 3; axis ++) {
+				bounds[axis] = AABBs[i].getMin(axis);
+				bounds[axis + 3] = AABBs[i].getMax(axis);
+			}
+			key = hashBytes((const char *)bounds, sizeof(bounds), key);
+		}
+	}
+	//The cache only has the broad phase's edges, and a brush's planes can change without its box
+	//changing, so the edges the colors were really made from have to match too
+	if (options.narrowPhase) {
+		for (size_t i = 0; i < refined.size(); i ++) {
+			int32_t edge[2] = {refined[i].first, refined[i].second};
+			key = hashBytes((const char *)edge, sizeof(edge), key);
+		}
+	}
+	return key;
+}
+
+//Everything once the collision graph is built: color it, then take the split maps out of it.
+//firstColors gets how many colors it took before improving or balancing.
+static int splitGraph(Graph &graph, size_t count, const SplitOptions &options, const std::vector<int> *faces, ThreadPool *pool, SplitStats &stats, Partition &parts, int &firstColors) {
+	stats.begin("color");
+	std::vector<int> regions;
+	firstColors = colorGraph(graph, count, options, pool, regions);
+	int removed = improveColors(graph, options, regions, stats);
+	balanceColors(graph, options, faces, regions, stats);
+
+	getParts(graph, count, stats, parts);
+	return removed;
+}
+
+int splitAABBs(std::vector<AABB> AABBs, const SplitOptions &options, Partition &parts, const std::vector<int> *faces) {
+	std::unique_ptr<ThreadPool> ownPool;
+	ThreadPool *pool = getPool(options, ownPool);
+	SplitStats noStats;
+	SplitStats &stats = (options.stats != NULL ? *options.stats : noStats);
+
+	size_t count = AABBs.size();
+
+	//Split algorithm by Whirligig231
+	stats.begin("collide");
+	Graph graph = getCollisions(std::move(AABBs), options.broadPhase, pool);
+	int firstColors = 0;
+	return splitGraph(graph, count, options, faces, pool, stats, parts, firstColors);
+}
+
+SplitResult splitMapText(const char *data, size_t length, const SplitOptions &options, MapSplit &split) {
+	split = MapSplit();
+	split.data = data;
+
+	std::unique_ptr<ThreadPool> ownPool;
+	ThreadPool *pool = getPool(options, ownPool);
+	SplitStats noStats;
+	SplitStats &stats = (options.stats != NULL ? *options.stats : noStats);
+
+	//Split it into pieces
+	stats.begin("scan");
+	if (!tokenizeMap(data, length, split.header, split.brushes)) {
+		split = MapSplit();
+		return SplitMismatchedBrace;
+	}
+	size_t count = split.brushes.size();
+
+	if (options.cache != NULL) {
+		//Take whatever still applies from last time
+		stats.begin("hash");
+		hashBrushes(data, split.brushes, split.hashes, *pool);
+		split.mapHash = getMapHash(data, split.header, split.hashes);
+
+		stats.begin("cache lookup");
+		const MapCache &cache = *options.cache;
+		size_t parsed = getCachedCollisions(cache, data, split.brushes, split.hashes, options.broadPhase, split.AABBs, split.edges, *pool);
+		split.reusedCount = count - parsed;
+
+		//The cache keeps the broad phase's edges, the narrow phase is cheap enough to redo
+		std::vector<std::pair<int, int> > refined;
+		int broadColors = 0;
+		if (options.narrowPhase) {
+			refined = split.edges;
+			refineEdges(data, split.brushes, split.AABBs, refined, options, pool, stats, split.edgesRemoved, broadColors);
+		}
+
+		//Same graph as last time, same colors. The AABBs go in and come back out at the end.
+		stats.begin("color");
+		if (options.countFaces) {
+			getBrushFaces(data, split.brushes, split.faces, *pool);
+		}
+		split.coloringKey = getColoringKey(options, split.AABBs, split.faces, refined);
+		bool reuse = (cache.isValid() && cache.getBrushCount() == count && cache.hasEdges(split.edges) && cache.getColoringKey() == split.coloringKey);
+		if (reuse && isCountingColorsSaved(options, stats)) {
+			//The cached colors have been improved and balanced since, so color it fresh to compare
+			split.colorsSaved = broadColors - colorCopy(split.AABBs, refined, options, pool);
+		}
+		Graph graph(std::move(split.AABBs), options.narrowPhase ? refined : split.edges);
+		split.colors.resize(count);
+		if (reuse) {
+			for (size_t i = 0; i < count; i ++) {
+				split.colors[i] = cache.getColors()[i];
+				graph.findNode((int)i)->setColor(split.colors[i]);
+			}
+		} else {
+			//Colors are cached after improving (the budget is in the key), so only new ones need it
+			std::vector<int> regions;
+			int firstColors = colorGraph(graph, count, options, pool, regions);
+			if (isCountingColorsSaved(options, stats)) {
+				split.colorsSaved = broadColors - firstColors;
+			}
+			split.colorsRemoved = improveColors(graph, options, regions, stats);
+			balanceColors(graph, options, &split.faces, regions, stats);
+			for (size_t i = 0; i < count; i ++) {
+				split.colors[i] = graph.findNode((int)i)->getColor();
+			}
+		}
+		getParts(graph, count, stats, split.parts);
+		graph.releaseBoxes(split.AABBs);
+	} else {
+		stats.begin("bounds");
+		getBrushAABBs(data, split.brushes, split.AABBs, *pool);
+		if (options.countFaces) {
+			getBrushFaces(data, split.brushes, split.faces, *pool);
+		}
+
+		//Split algorithm by Whirligig231. The AABBs go into the graph and come back out at the end.
+		stats.begin("collide");
+		std::vector<std::pair<int, int> > pairs;
+		findOverlaps(split.AABBs, options.broadPhase, pairs, pool);
+		int broadColors = 0;
+		if (options.narrowPhase) {
+			refineEdges(data, split.brushes, split.AABBs, pairs, options, pool, stats, split.edgesRemoved, broadColors);
+		}
+		Graph graph(std::move(split.AABBs), pairs);
+		std::vector<std::pair<int, int> >().swap(pairs);
+		int firstColors = 0;
+		split.colorsRemoved = splitGraph(graph, count, options, &split.faces, pool, stats, split.parts, firstColors);
+		if (isCountingColorsSaved(options, stats)) {
+			split.colorsSaved = broadColors - firstColors;
+		}
+		graph.releaseBoxes(split.AABBs);
+	}
+	if (options.narrowPhase) {
+		stats.setNarrowPhase(split.edgesRemoved, split.colorsSaved);
+	}
+
+	return SplitOK;
+}
+
+static void writeCstring(std::ostream &stream, const char *string) {
+	stream.write(string, strlen(string));
+}
+
+void writeInteriorExports(std::ostream &stream, const std::string &interiorName, size_t count) {
+	std::vector<size_t> parts;
+	for (size_t i = 0; i < count; i ++) {
+		parts.push_back(i);
+	}
+	writeInteriorExports(stream, interiorName, parts);
+}
+
+void writeInteriorExports(std::ostream &stream, const std::string &interiorName, const std::vector<size_t> &parts) {
+	for (size_t i = 0; i < parts.size(); i ++) {
+		writeCstring(stream, "   new InteriorInstance() {\n"
+		                     "      position = \"0 0 0\";\n"
+		                     "      rotation = \"1 0 0 0\";\n"
+		                     "      scale = \"1 1 1\";\n");
+
+		//   interiorFile = "<path/to/>Mapname-0.dif";
+		writeCstring(stream, "      interiorFile = \"");
+		writeCstring(stream, interiorName.c_str());
+		writeCstring(stream, "-");
+		writeCstring(stream, std::to_string(parts[i]).c_str());
+		writeCstring(stream, ".dif\";\n");
+		writeCstring(stream, "      showTerrainInside = \"1\";\n");
+		writeCstring(stream, "   };\n");
+	}
+}
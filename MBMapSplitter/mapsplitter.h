@@ -0,0 +1,170 @@
+//
+//  mapsplitter.h
+//  MBMapSplitter
+//
+//  Copyright (c) 2015 HiGuy Smith
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#ifndef __MBMapSplitter__mapsplitter__
+#define __MBMapSplitter__mapsplitter__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "aabbcolor.h"
+#include "cache.h"
+#include "mapfile.h"
+#include "stats.h"
+#include "threadpool.h"
+
+//The splitter as a library. Hand it a map's text and it works out which brushes go in which split
+//map, and gives the split maps back as pieces of that text. It never touches the disk: reading
+//and writing files is up to whoever calls it (see main.cpp). Nothing here has any global state,
+//so any number of splits can run at once, each on its own pool or all sharing one.
+
+struct SplitOptions {
+	BroadPhase broadPhase;
+	//Colors each brush with whichever color's split map grows least with it, so every split map
+	//covers as little of the level as it can and can be culled by the engine. With regions, the
+	//level is first cut into that many regions by brush count and no split map crosses from one
+	//into another, at the cost of more split maps. Improving and balancing keep to the regions too.
+	bool local;
+	int regions;
+	//Colors on the pool instead of with DSATUR, which is much quicker on huge maps but usually
+	//makes a split map or two more. The colors depend on improve's seed, not on the pool.
+	bool parallelColor;
+	//Pool to spread the work over. NULL does everything on the calling thread.
+	ThreadPool *pool;
+	//An earlier run's results to take what still applies from, or NULL. Only read from, never
+	//written, so one cache can be shared between splits.
+	const MapCache *cache;
+	//Times every stage, or NULL
+	SplitStats *stats;
+	//How long to keep looking for a coloring with fewer colors (so fewer split maps) once DSATUR
+	//has found one. Unset, the DSATUR coloring is used as is.
+	ColoringBudget improve;
+	//Most brushes (or faces, with countFaces) any one split map can have, or 0 for no limit. Split
+	//maps are only added when they have to be.
+	long maxPartSize;
+	bool countFaces;
+	//Evens out how big the split maps are, without adding any. A maxPartSize does this too.
+	bool balance;
+	//Tests the brushes the AABBs say collide again, as the convex shapes their planes make, and
+	//drops the ones that don't (see refineOverlaps). Brushes have to overlap by more than
+	//touchTolerance to collide. Needs the map text, so splitAABBs doesn't do it.
+	bool narrowPhase;
+	double touchTolerance;
+	//Also colors the graph as it would have been without the narrow phase, to see how many split
+	//maps it saved (see MapSplit::getColorsSaved). Always done with stats on.
+	bool countColorsSaved;
+
+	SplitOptions() : broadPhase(BroadPhaseAuto), local(false), regions(0), parallelColor(false), pool(NULL), cache(NULL), stats(NULL), maxPartSize(0), countFaces(false), balance(false), narrowPhase(false), touchTolerance(0.01), countColorsSaved(false) {}
+};
+
+enum SplitResult {
+	SplitOK,
+	SplitMismatchedBrace
+};
+
+//A split map. Everything in it points into the map text it was made from, so that has to stay
+//around (and unchanged) for as long as this does.
+class MapSplit {
+	const char *data;
+	std::vector<MapSpan> header;
+	std::vector<MapSpan> brushes;
+	std::vector<AABB> AABBs;
+	std::vector<int> faces;
+	Partition parts;
+
+	//Only filled in when there's a cache, for writing a new one
+	std::vector<uint64_t> hashes;
+	uint64_t mapHash;
+	std::vector<std::pair<int, int> > edges;
+	std::vector<int> colors;
+	uint64_t coloringKey;
+	size_t reusedCount;
+	int colorsRemoved;
+	size_t edgesRemoved;
+	int colorsSaved;
+
+	friend SplitResult splitMapText(const char *data, size_t length, const SplitOptions &options, MapSplit &split);
+public:
+	MapSplit();
+
+	const char *getData() const { return data; }
+	const std::vector<MapSpan> &getHeader() const { return header; }
+	const std::vector<MapSpan> &getBrushes() const { return brushes; }
+	std::vector<AABB> &getAABBs() { return AABBs; }
+	//Only filled in with options.countFaces
+	const std::vector<int> &getFaces() const { return faces; }
+
+	//Split map i is made of these brushes, in map order
+	size_t getPartCount() const { return parts.getClassCount(); }
+	PartitionClass getPart(size_t i) const { return parts.getClass(i); }
+	const Partition &getParts() const { return parts; }
+
+	//Split map i is a '{', the header, each of its brushes followed by "\r\n", and a '}'. These hand
+	//it over piece by piece straight out of the map text, tell you how long it is all together,
+	//or put it all in one string.
+	void forEachPiece(size_t i, const std::function<void(const char *, size_t)> &callback) const;
+	size_t getPartLength(size_t i) const;
+	void getPartText(size_t i, std::string &text) const;
+
+	uint64_t getMapHash() const { return mapHash; }
+	const std::vector<uint64_t> &getHashes() const { return hashes; }
+	const std::vector<std::pair<int, int> > &getEdges() const { return edges; }
+	const std::vector<int> &getColors() const { return colors; }
+	uint64_t getColoringKey() const { return coloringKey; }
+	//How many brushes came out of the cache rather than being parsed
+	size_t getReusedCount() const { return reusedCount; }
+	//How many split maps options.improve saved
+	int getColorsRemoved() const { return colorsRemoved; }
+	//How many edges options.narrowPhase dropped, and how many fewer colors the coloring needed for
+	//it before improving or balancing (only with options.countColorsSaved or stats, 0 otherwise)
+	size_t getEdgesRemoved() const { return edgesRemoved; }
+	int getColorsSaved() const { return colorsSaved; }
+};
+
+//Splits the map in data. Returns SplitMismatchedBrace (leaving split empty) if its braces don't
+//match up.
+SplitResult splitMapText(const char *data, size_t length, const SplitOptions &options, MapSplit &split);
+
+//What splitMapText does once it knows every brush's AABB, for when the map text isn't all there to
+//give it (see scanMapStream). Fills parts with the brushes in each split map, and returns how many
+//split maps options.improve saved. Pass the AABBs in with std::move if they aren't needed
+//afterwards. With options.countFaces, faces has each brush's face count. options.cache isn't used.
+int splitAABBs(std::vector<AABB> AABBs, const SplitOptions &options, Partition &parts, const std::vector<int> *faces = NULL);
+
+//Sums up the options that change how a graph is colored, improve's budget included, so colors
+//made one way aren't reused for another. When the split maps are balanced by face count, faces
+//(each brush's, see getBrushFaces) goes in too, and with local or regions, so do the AABBs.
+//With narrowPhase, so do the edges it left (refined). 0 for plain DSATUR.
+uint64_t getColoringKey(const SplitOptions &options, std::vector<AABB> &AABBs, const std::vector<int> &faces, const std::vector<std::pair<int, int> > &refined);
+
+//Writes the InteriorInstances for a map's split maps, one per split, as interiorName-i.dif
+void writeInteriorExports(std::ostream &stream, const std::string &interiorName, size_t count);
+//Same, for only some of them (say, the ones that converted)
+void writeInteriorExports(std::ostream &stream, const std::string &interiorName, const std::vector<size_t> &parts);
+
+#endif
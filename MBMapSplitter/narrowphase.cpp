@@ -0,0 +1,231 @@
+//
+//  narrowphase.cpp
+//  MBMapSplitter
+//
+//  Copyright (c) 2015 HiGuy Smith
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#include <algorithm>
+#include <cmath>
+#include "narrowphase.h"
+
+using namespace std;
+
+// How far off a plane a point can be and still count as on it. Maps write coordinates to a
+// thousandth, so this is a good way past rounding.
+#define PLANE_EPSILON 0.01
+// Directions closer to parallel than this (by the length of their cross product) are the same.
+#define PARALLEL_EPSILON 1e-6
+
+static inline double dot(const double *a, const double *b) {
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static inline void cross(const double *a, const double *b, double *out) {
+	out[0] = a[1] * b[2] - a[2] * b[1];
+	out[1] = a[2] * b[0] - a[0] * b[2];
+	out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+// Scales a vector to unit length. Returns false if it's too short to have a direction.
+
+static inline bool normalize(double *v) {
+	double length = sqrt(dot(v, v));
+	if (length < PARALLEL_EPSILON)
+		return false;
+	v[0] /= length;
+	v[1] /= length;
+	v[2] /= length;
+	return true;
+}
+
+// Adds a direction to a list unless it's parallel to one already there.
+
+static void addDirection(vector<double> &directions, const double *direction) {
+	for (size_t i = 0; i < directions.size(); i += 3) {
+		double between[3];
+		cross(&directions[i], direction, between);
+		if (dot(between, between) < PARALLEL_EPSILON * PARALLEL_EPSILON)
+			return;
+	}
+	directions.insert(directions.end(), direction, direction + 3);
+}
+
+bool ConvexBrush::build(const double *points, int faceCount) {
+	this->planes.clear();
+	this->vertices.clear();
+	this->edges.clear();
+
+	for (int i = 0; i < faceCount; i ++) {
+		const double *p = points + i * 9;
+		double a[3] = {p[0] - p[3], p[1] - p[4], p[2] - p[5]};
+		double b[3] = {p[6] - p[3], p[7] - p[4], p[8] - p[5]};
+		double normal[4];
+		cross(a, b, normal);
+		if (!normalize(normal))
+			continue;
+		normal[3] = dot(normal, p + 3);
+		this->planes.insert(this->planes.end(), normal, normal + 4);
+	}
+
+	// The corners are wherever three planes meet without being outside any other
+	int planeCount = (int)(this->planes.size() / 4);
+	for (int i = 0; i < planeCount; i ++) {
+		const double *pi = &this->planes[i * 4];
+		for (int j = i + 1; j < planeCount; j ++) {
+			const double *pj = &this->planes[j * 4];
+			double jk[3], ki[3], ij[3];
+			cross(pi, pj, ij);
+			if (dot(ij, ij) < PARALLEL_EPSILON * PARALLEL_EPSILON)
+				continue;
+			for (int k = j + 1; k < planeCount; k ++) {
+				const double *pk = &this->planes[k * 4];
+				double det = dot(pk, ij);
+				if (fabs(det) < PARALLEL_EPSILON)
+					continue;
+				cross(pj, pk, jk);
+				cross(pk, pi, ki);
+				double corner[3];
+				for (int axis = 0; axis < 3; axis ++)
+					corner[axis] = (pi[3] * jk[axis] + pj[3] * ki[axis] + pk[3] * ij[axis]) / det;
+
+				bool inside = true;
+				for (int m = 0; m < planeCount && inside; m ++)
+					inside = dot(&this->planes[m * 4], corner) <= this->planes[m * 4 + 3] + PLANE_EPSILON;
+				for (size_t m = 0; m < this->vertices.size() && inside; m += 3) {
+					double dx = this->vertices[m] - corner[0], dy = this->vertices[m + 1] - corner[1], dz = this->vertices[m + 2] - corner[2];
+					inside = (dx * dx + dy * dy + dz * dz > PLANE_EPSILON * PLANE_EPSILON);
+				}
+				if (inside)
+					this->vertices.insert(this->vertices.end(), corner, corner + 3);
+			}
+		}
+	}
+	if (this->vertices.size() < 4 * 3) {
+		this->planes.clear();
+		this->vertices.clear();
+		return false;
+	}
+
+	// The edges are wherever two planes share two corners
+	for (int i = 0; i < planeCount; i ++) {
+		const double *pi = &this->planes[i * 4];
+		for (int j = i + 1; j < planeCount; j ++) {
+			const double *pj = &this->planes[j * 4];
+			int shared = 0;
+			for (size_t m = 0; m < this->vertices.size() && shared < 2; m += 3) {
+				const double *corner = &this->vertices[m];
+				shared += (fabs(dot(pi, corner) - pi[3]) <= PLANE_EPSILON && fabs(dot(pj, corner) - pj[3]) <= PLANE_EPSILON);
+			}
+			double direction[3];
+			cross(pi, pj, direction);
+			if (shared == 2 && normalize(direction))
+				addDirection(this->edges, direction);
+		}
+	}
+	return true;
+}
+
+bool ConvexBrush::isEmpty() const {
+	return this->vertices.empty();
+}
+
+// How far two sets of corners overlap along an axis (negative if there's a gap between them).
+// The axis doesn't need to be unit length; the overlap is divided by its length.
+
+static double getOverlap(const vector<double> &first, const vector<double> &second, const double *axis) {
+	double min1 = INFINITY, max1 = -INFINITY, min2 = INFINITY, max2 = -INFINITY;
+	for (size_t i = 0; i < first.size(); i += 3) {
+		double d = dot(&first[i], axis);
+		min1 = min(min1, d);
+		max1 = max(max1, d);
+	}
+	for (size_t i = 0; i < second.size(); i += 3) {
+		double d = dot(&second[i], axis);
+		min2 = min(min2, d);
+		max2 = max(max2, d);
+	}
+	return (min(max1 - min2, max2 - min1)) / sqrt(dot(axis, axis));
+}
+
+bool ConvexBrush::overlaps(const ConvexBrush &other, double tolerance) const {
+	// Two convex shapes are apart if and only if one of their face normals, or a cross product of
+	// an edge from each, separates them.
+	for (size_t i = 0; i < this->planes.size(); i += 4) {
+		if (getOverlap(this->vertices, other.vertices, &this->planes[i]) <= tolerance)
+			return false;
+	}
+	for (size_t i = 0; i < other.planes.size(); i += 4) {
+		if (getOverlap(this->vertices, other.vertices, &other.planes[i]) <= tolerance)
+			return false;
+	}
+	for (size_t i = 0; i < this->edges.size(); i += 3) {
+		for (size_t j = 0; j < other.edges.size(); j += 3) {
+			double axis[3];
+			cross(&this->edges[i], &other.edges[j], axis);
+			if (dot(axis, axis) < PARALLEL_EPSILON * PARALLEL_EPSILON)
+				continue;
+			if (getOverlap(this->vertices, other.vertices, axis) <= tolerance)
+				return false;
+		}
+	}
+	return true;
+}
+
+size_t refineOverlaps(const char *data, const vector<MapSpan> &brushes, vector<pair<int, int> > &pairs, double tolerance, ThreadPool *pool) {
+	// Only brushes with a pair are worth building
+	vector<char> needed(brushes.size(), 0);
+	for (size_t i = 0; i < pairs.size(); i ++) {
+		needed[pairs[i].first] = 1;
+		needed[pairs[i].second] = 1;
+	}
+
+	int slots = ThreadPool::getSlotCount(pool);
+	vector<vector<double> > points(slots);
+	vector<ConvexBrush> shapes(brushes.size());
+	ThreadPool::forRange(pool, brushes.size(), 256, [&](size_t begin, size_t end, int slot) {
+		for (size_t i = begin; i < end; i ++) {
+			if (!needed[i])
+				continue;
+			int faces = getBrushPlanePoints(data + brushes[i].offset, brushes[i].length, points[slot]);
+			if (faces > 0)
+				shapes[i].build(&points[slot][0], faces);
+		}
+	});
+
+	vector<char> keep(pairs.size(), 1);
+	ThreadPool::forRange(pool, pairs.size(), 1024, [&](size_t begin, size_t end, int) {
+		for (size_t i = begin; i < end; i ++) {
+			const ConvexBrush &first = shapes[pairs[i].first];
+			const ConvexBrush &second = shapes[pairs[i].second];
+			if (!first.isEmpty() && !second.isEmpty())
+				keep[i] = first.overlaps(second, tolerance);
+		}
+	});
+
+	size_t kept = 0;
+	for (size_t i = 0; i < pairs.size(); i ++) {
+		if (keep[i])
+			pairs[kept ++] = pairs[i];
+	}
+	size_t dropped = pairs.size() - kept;
+	pairs.resize(kept);
+	return dropped;
+}
@@ -0,0 +1,65 @@
+//
+//  narrowphase.h
+//  MBMapSplitter
+//
+//  Copyright (c) 2015 HiGuy Smith
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#ifndef __MBMapSplitter__narrowphase__
+#define __MBMapSplitter__narrowphase__
+
+#include <utility>
+#include <vector>
+#include "mapfile.h"
+#include "threadpool.h"
+
+using namespace std;
+
+// Narrow-phase collision detection. AABBs are only ever conservative: brushes on a diagonal, in an
+// L or just touching all look like they collide. These rebuild each brush as the convex shape its
+// planes really make and test those instead.
+
+// A brush's convex shape. Each face's three points give a plane, facing out the way map editors
+// write them (clockwise, seen from outside), and the brush is everything behind every plane.
+
+class ConvexBrush {
+private:
+	vector<double> planes;    // Four numbers a plane: the unit normal, then its distance
+	vector<double> vertices;  // Three numbers a corner
+	vector<double> edges;     // Three numbers an edge direction, unit length, no two parallel
+public:
+	// Builds the shape from nine numbers a face (see getBrushPlanePoints). Returns false, leaving
+	// the shape empty, if the planes don't close around anything.
+	bool build(const double *points, int faceCount);
+	bool isEmpty() const;
+	// Whether the two shapes overlap by more than tolerance along every axis that could separate
+	// them. With a tolerance of 0, brushes that only share a face don't overlap. A negative one
+	// counts brushes that close as overlapping too.
+	bool overlaps(const ConvexBrush &other, double tolerance) const;
+};
+
+// Drops every pair (from findOverlaps) whose brushes don't really overlap; see
+// ConvexBrush::overlaps. A brush whose shape can't be built is left overlapping whatever its AABB
+// does, so nothing is ever dropped that might collide. Pairs stay in the order they were in.
+// Returns how many were dropped.
+
+size_t refineOverlaps(const char *data, const vector<MapSpan> &brushes, vector<pair<int, int> > &pairs, double tolerance, ThreadPool *pool = NULL);
+
+#endif
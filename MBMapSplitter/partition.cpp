@@ -0,0 +1,82 @@
+//
+//  partition.cpp
+//  MBMapSplitter
+//
+//  Copyright (c) 2015 HiGuy Smith
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#include <utility>
+#include "partition.h"
+
+// Creates a partition with no classes.
+
+Partition::Partition() : offsets(1, 0) {
+}
+
+// Takes the other partition's arrays, leaving it with no classes.
+
+Partition::Partition(Partition &&other) : offsets(std::move(other.offsets)), indices(std::move(other.indices)) {
+	other.clear();
+}
+
+Partition &Partition::operator=(Partition &&other) {
+	if (this != &other) {
+		this->offsets = std::move(other.offsets);
+		this->indices = std::move(other.indices);
+		other.clear();
+	}
+	return *this;
+}
+
+void Partition::build(const vector<int> &classes) {
+	this->build(classes.size(), [&classes](size_t i) { return classes[i]; }, [](size_t i) { return (int)i; });
+}
+
+// Empties it out. The memory is kept for the next build.
+
+void Partition::clear() {
+	this->offsets.assign(1, 0);
+	this->indices.clear();
+}
+
+// Returns the number of classes.
+
+size_t Partition::getClassCount() const {
+	return this->offsets.size() - 1;
+}
+
+// Returns class i, as a view into the partition.
+
+PartitionClass Partition::getClass(size_t i) const {
+	const int *data = this->indices.data();
+	return PartitionClass(data + this->offsets[i], data + this->offsets[i + 1]);
+}
+
+size_t Partition::getIndexCount() const {
+	return this->indices.size();
+}
+
+const size_t *Partition::getOffsets() const {
+	return this->offsets.data();
+}
+
+const int *Partition::getIndices() const {
+	return this->indices.data();
+}
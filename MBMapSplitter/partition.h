@@ -0,0 +1,115 @@
+//
+//  partition.h
+//  MBMapSplitter
+//
+//  Copyright (c) 2015 HiGuy Smith
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#ifndef __MBMapSplitter__partition__
+#define __MBMapSplitter__partition__
+
+#include <stddef.h>
+#include <vector>
+
+using namespace std;
+
+// One class of a Partition: a run of indices in its flat array. It doesn't own anything, so it's
+// only good for as long as the partition it came from stays as it is.
+
+class PartitionClass {
+private:
+	const int *first;
+	const int *last;
+public:
+	PartitionClass(const int *first, const int *last) : first(first), last(last) {}
+	const int *begin() const { return this->first; }
+	const int *end() const { return this->last; }
+	size_t size() const { return (size_t)(this->last - this->first); }
+	bool empty() const { return this->first == this->last; }
+	int operator[](size_t i) const { return this->first[i]; }
+};
+
+// Indices sorted into classes (for us, brushes into split maps by color). Every class shares one
+// flat array of indices, and offsets[i] .. offsets[i + 1] are class i's, so there are only ever two
+// allocations however many classes there are. Indices keep the order they were added in within
+// their class. It can be moved but never copied, so a big one can't get copied by accident on its
+// way through the pipeline.
+
+class Partition {
+private:
+	vector<size_t> offsets;
+	vector<int> indices;
+
+	Partition(const Partition &other) = delete;
+	Partition &operator=(const Partition &other) = delete;
+public:
+	Partition();
+	Partition(Partition &&other);
+	Partition &operator=(Partition &&other);
+
+	// Sorts itemCount items into classes, replacing what was there: item i goes into class
+	// classOf(i) as indexOf(i), or nowhere if classOf(i) is negative. There are as many classes as
+	// the highest class plus one. Two passes over the items, and no other memory.
+	template <class ClassOf, class IndexOf>
+	void build(size_t itemCount, ClassOf classOf, IndexOf indexOf);
+	// Same, with classes[i] as item i's class and i as its index
+	void build(const vector<int> &classes);
+	void clear();
+
+	size_t getClassCount() const;
+	PartitionClass getClass(size_t i) const;
+	// How many indices there are in all the classes together
+	size_t getIndexCount() const;
+	// The arrays themselves: getClassCount() + 1 offsets, and getIndexCount() indices
+	const size_t *getOffsets() const;
+	const int *getIndices() const;
+};
+
+template <class ClassOf, class IndexOf>
+void Partition::build(size_t itemCount, ClassOf classOf, IndexOf indexOf) {
+	size_t classCount = 0;
+	for (size_t i = 0; i < itemCount; i++) {
+		int c = classOf(i);
+		if (c >= 0 && (size_t)c + 1 > classCount)
+			classCount = (size_t)c + 1;
+	}
+	this->offsets.assign(classCount + 1, 0);
+	for (size_t i = 0; i < itemCount; i++) {
+		int c = classOf(i);
+		if (c >= 0)
+			this->offsets[c + 1]++;
+	}
+	for (size_t c = 0; c < classCount; c++)
+		this->offsets[c + 1] += this->offsets[c];
+
+	// Fill each class from the back, pulling its end offset down as we go. That leaves each one
+	// holding where its class starts, one slot along, so there's no second array of positions.
+	this->indices.resize(this->offsets[classCount]);
+	for (size_t i = itemCount; i-- > 0;) {
+		int c = classOf(i);
+		if (c >= 0)
+			this->indices[--this->offsets[c + 1]] = indexOf(i);
+	}
+	for (size_t c = 0; c < classCount; c++)
+		this->offsets[c] = this->offsets[c + 1];
+	this->offsets[classCount] = this->indices.size();
+}
+
+#endif
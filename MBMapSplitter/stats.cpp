@@ -0,0 +1,286 @@
+//
+//  stats.cpp
+//  MBMapSplitter
+//
+//  Copyright (c) 2015 HiGuy Smith
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#include "stats.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <sys/time.h>
+#endif
+
+//Counted by countAllocation while anyone has stats on. It's one relaxed add per allocation, and
+//nothing at all otherwise.
+static std::atomic<int> gCountingAllocations(0);
+static std::atomic<uint64_t> gAllocations(0);
+static std::atomic<uint64_t> gAllocatedBytes(0);
+
+void countAllocation(size_t size) {
+	if (gCountingAllocations.load(std::memory_order_relaxed)) {
+		gAllocations.fetch_add(1, std::memory_order_relaxed);
+		gAllocatedBytes.fetch_add(size, std::memory_order_relaxed);
+	}
+}
+
+static double getWallTime() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//User plus system time of every thread in the process
+static double getCPUTime() {
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+	if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) {
+		return 0;
+	}
+	ULARGE_INTEGER kernelTime, userTime;
+	kernelTime.LowPart = kernel.dwLowDateTime;
+	kernelTime.HighPart = kernel.dwHighDateTime;
+	userTime.LowPart = user.dwLowDateTime;
+	userTime.HighPart = user.dwHighDateTime;
+	return (kernelTime.QuadPart + userTime.QuadPart) / 1e7;
+#else
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+#endif
+}
+
+//Starts measuring peak memory from now, where we can
+static void resetPeakMemory() {
+#ifdef __linux__
+	FILE *file = fopen("/proc/self/clear_refs", "w");
+	if (file != NULL) {
+		fputs("5", file);
+		fclose(file);
+	}
+#endif
+}
+
+//Peak resident memory, in bytes
+static double getPeakMemory() {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		return 0;
+	}
+	return (double)counters.PeakWorkingSetSize;
+#else
+#ifdef __linux__
+	//VmHWM is the one clear_refs resets, ru_maxrss never goes down
+	FILE *file = fopen("/proc/self/status", "r");
+	if (file != NULL) {
+		char line[256];
+		while (fgets(line, sizeof(line), file)) {
+			if (!strncmp(line, "VmHWM:", 6)) {
+				fclose(file);
+				return atof(line + 6) * 1024.0;
+			}
+		}
+		fclose(file);
+	}
+#endif
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+	return (double)usage.ru_maxrss; //Bytes here, kilobytes everywhere else
+#else
+	return usage.ru_maxrss * 1024.0;
+#endif
+#endif
+}
+
+SplitStats::SplitStats(bool enabled) : enabled(enabled), running(false), startWall(0), startCPU(0), startAllocations(0), startAllocatedBytes(0), brushCount(0), edgeCount(0), maxDegree(0), colorCount(0), narrowPhase(false), edgesRemoved(0), colorsSaved(0) {
+	if (enabled) {
+		gCountingAllocations ++;
+	}
+}
+
+SplitStats::~SplitStats() {
+	if (enabled) {
+		gCountingAllocations --;
+	}
+}
+
+bool SplitStats::isEnabled() const {
+	return enabled;
+}
+
+void SplitStats::begin(const char *name) {
+	if (!enabled) {
+		return;
+	}
+	end();
+
+	current.name = name;
+	resetPeakMemory();
+	startAllocations = gAllocations.load();
+	startAllocatedBytes = gAllocatedBytes.load();
+	startCPU = getCPUTime();
+	startWall = getWallTime();
+	running = true;
+}
+
+void SplitStats::end() {
+	if (!enabled || !running) {
+		return;
+	}
+	current.wallTime = getWallTime() - startWall;
+	current.cpuTime = getCPUTime() - startCPU;
+	current.allocations = gAllocations.load() - startAllocations;
+	current.allocatedBytes = gAllocatedBytes.load() - startAllocatedBytes;
+	current.peakMemory = getPeakMemory();
+	stages.push_back(current);
+	running = false;
+}
+
+void SplitStats::setGraph(size_t brushCount, size_t edgeCount, int maxDegree, int colorCount) {
+	this->brushCount = brushCount;
+	this->edgeCount = edgeCount;
+	this->maxDegree = maxDegree;
+	this->colorCount = colorCount;
+}
+
+void SplitStats::setSplitVolumes(const std::vector<double> &volumes) {
+	splitVolumes = volumes;
+}
+
+void SplitStats::setNarrowPhase(size_t edgesRemoved, int colorsSaved) {
+	narrowPhase = true;
+	this->edgesRemoved = edgesRemoved;
+	this->colorsSaved = colorsSaved;
+}
+
+const std::vector<SplitStats::Stage> &SplitStats::getStages() const {
+	return stages;
+}
+
+void SplitStats::printTable(std::ostream &stream) const {
+	char line[256];
+	snprintf(line, sizeof(line), "%-14s %10s %10s %12s %12s %10s\n", "stage", "wall (s)", "cpu (s)", "allocations", "alloc (MB)", "peak (MB)");
+	stream << line;
+
+	Stage total;
+	total.name = "total";
+	total.wallTime = 0;
+	total.cpuTime = 0;
+	total.allocations = 0;
+	total.allocatedBytes = 0;
+	total.peakMemory = 0;
+	for (size_t i = 0; i <= stages.size(); i ++) {
+		const Stage &stage = (i < stages.size() ? stages[i] : total);
+		snprintf(line, sizeof(line), "%-14s %10.4f %10.4f %12llu %12.1f %10.1f\n", stage.name.c_str(), stage.wallTime, stage.cpuTime, (unsigned long long)stage.allocations, stage.allocatedBytes / 1048576.0, stage.peakMemory / 1048576.0);
+		stream << line;
+
+		if (i < stages.size()) {
+			total.wallTime += stage.wallTime;
+			total.cpuTime += stage.cpuTime;
+			total.allocations += stage.allocations;
+			total.allocatedBytes += stage.allocatedBytes;
+			if (stage.peakMemory > total.peakMemory) {
+				total.peakMemory = stage.peakMemory;
+			}
+		}
+	}
+	stream << brushCount << " brushes, " << edgeCount << " edges, max degree " << maxDegree << ", " << colorCount << " colors" << std::endl;
+	if (narrowPhase) {
+		stream << "narrow phase: " << edgesRemoved << " edges removed, " << colorsSaved << " colors saved" << std::endl;
+	}
+
+	if (!splitVolumes.empty()) {
+		double totalVolume = 0;
+		std::string volumes;
+		for (size_t i = 0; i < splitVolumes.size(); i ++) {
+			totalVolume += splitVolumes[i];
+			snprintf(line, sizeof(line), " %.0f", splitVolumes[i]);
+			volumes += line;
+		}
+		snprintf(line, sizeof(line), "split bounds: %.0f total volume, per split:", totalVolume);
+		stream << line << volumes << std::endl;
+	}
+}
+
+//Just enough escaping for file paths
+static void writeJSONString(std::ostream &stream, const std::string &string) {
+	stream << '"';
+	for (size_t i = 0; i < string.length(); i ++) {
+		unsigned char c = (unsigned char)string[i];
+		if (c == '"' || c == '\\') {
+			stream << '\\' << c;
+		} else if (c < 0x20) {
+			char escaped[8];
+			snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+			stream << escaped;
+		} else {
+			stream << c;
+		}
+	}
+	stream << '"';
+}
+
+void SplitStats::printJSON(std::ostream &stream, const std::string &mapPath) const {
+	char number[64];
+	stream << "{\"map\":";
+	writeJSONString(stream, mapPath);
+	stream << ",\"brushes\":" << brushCount << ",\"edges\":" << edgeCount << ",\"maxDegree\":" << maxDegree << ",\"colors\":" << colorCount;
+	double totalVolume = 0;
+	for (size_t i = 0; i < splitVolumes.size(); i ++) {
+		totalVolume += splitVolumes[i];
+	}
+	snprintf(number, sizeof(number), "%.0f", totalVolume);
+	stream << ",\"totalVolume\":" << number << ",\"splitVolumes\":[";
+	for (size_t i = 0; i < splitVolumes.size(); i ++) {
+		snprintf(number, sizeof(number), "%.0f", splitVolumes[i]);
+		stream << (i > 0 ? "," : "") << number;
+	}
+	stream << "]";
+	if (narrowPhase) {
+		stream << ",\"edgesRemoved\":" << edgesRemoved << ",\"colorsSaved\":" << colorsSaved;
+	}
+	stream << ",\"stages\":[";
+	for (size_t i = 0; i < stages.size(); i ++) {
+		const Stage &stage = stages[i];
+		if (i > 0) {
+			stream << ",";
+		}
+		stream << "{\"name\":";
+		writeJSONString(stream, stage.name);
+		snprintf(number, sizeof(number), "%.6f", stage.wallTime);
+		stream << ",\"wall\":" << number;
+		snprintf(number, sizeof(number), "%.6f", stage.cpuTime);
+		stream << ",\"cpu\":" << number;
+		stream << ",\"allocations\":" << stage.allocations << ",\"allocatedBytes\":" << stage.allocatedBytes;
+		snprintf(number, sizeof(number), "%.0f", stage.peakMemory);
+		stream << ",\"peakBytes\":" << number << "}";
+	}
+	stream << "]}" << std::endl;
+}
@@ -0,0 +1,96 @@
+//
+//  stats.h
+//  MBMapSplitter
+//
+//  Copyright (c) 2015 HiGuy Smith
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#ifndef __MBMapSplitter__stats__
+#define __MBMapSplitter__stats__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <ostream>
+#include <string>
+#include <vector>
+
+//Counts an allocation toward every enabled SplitStats' stages. The library never replaces the
+//allocator itself, since that would replace it for whoever links it in too; a program that wants
+//allocations in its stats calls this from its own operator new (see main.cpp). Without it they
+//stay at zero.
+void countAllocation(size_t size);
+
+//Times each stage of a split for --stats. Starting a stage ends the one before it. A disabled
+//SplitStats does nothing at all, so the splitter can call it unconditionally.
+//CPU time, allocations and peak memory are for the whole process, so they only mean something
+//while one map is being split at a time. Peak memory is per stage on Linux, where the high-water
+//mark can be reset; elsewhere it's the peak so far.
+class SplitStats {
+public:
+	struct Stage {
+		std::string name;
+		double wallTime;
+		double cpuTime;
+		uint64_t allocations;
+		uint64_t allocatedBytes;
+		double peakMemory;
+	};
+
+private:
+	bool enabled;
+	bool running;
+	Stage current;
+	double startWall;
+	double startCPU;
+	uint64_t startAllocations;
+	uint64_t startAllocatedBytes;
+	std::vector<Stage> stages;
+
+	size_t brushCount;
+	size_t edgeCount;
+	int maxDegree;
+	int colorCount;
+	std::vector<double> splitVolumes;
+	bool narrowPhase;
+	size_t edgesRemoved;
+	int colorsSaved;
+
+public:
+	SplitStats(bool enabled = false);
+	~SplitStats();
+
+	bool isEnabled() const;
+
+	void begin(const char *name);
+	void end();
+	void setGraph(size_t brushCount, size_t edgeCount, int maxDegree, int colorCount);
+	//How much of the level each split map's bounds take up, which is what culling goes by
+	void setSplitVolumes(const std::vector<double> &volumes);
+	//What the narrow phase took out of the graph, and how many colors that saved
+	void setNarrowPhase(size_t edgesRemoved, int colorsSaved);
+
+	const std::vector<Stage> &getStages() const;
+
+	void printTable(std::ostream &stream) const;
+	//All on one line, so a log with many maps in it has one line of JSON per map
+	void printJSON(std::ostream &stream, const std::string &mapPath) const;
+};
+
+#endif
@@ -0,0 +1,277 @@
+//
+//  threadpool.cpp
+//  MBMapSplitter
+//
+//  Copyright (c) 2015 HiGuy Smith
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#include "threadpool.h"
+
+//Which pool this thread works for, if any, and which of its queues is this thread's own
+static thread_local ThreadPool *currentPool = NULL;
+static thread_local int currentQueue = 0;
+
+//The parallelFor jobs this thread is in the middle of a chunk of, innermost first. A thread that
+//is waiting on something mustn't start another chunk of a job further down its own stack, or that
+//job could end up with more slots than there are threads.
+struct ActiveJob {
+	const ParallelJob *job;
+	ActiveJob *next;
+};
+static thread_local ActiveJob *currentJobs = NULL;
+
+static bool isActive(const ParallelJob *job) {
+	for (ActiveJob *active = currentJobs; active != NULL; active = active->next) {
+		if (active->job == job) {
+			return true;
+		}
+	}
+	return false;
+}
+
+//One parallelFor call. Helpers may still be holding onto it after the caller has returned, so
+//it's shared rather than living on the caller's stack.
+struct ParallelJob {
+	ThreadPool *pool;
+	size_t count;
+	size_t chunkSize;
+	size_t chunkCount;
+	std::function<void(size_t, size_t, int)> body;
+
+	std::atomic<size_t> nextChunk;
+	std::atomic<int> nextSlot;
+	std::atomic<size_t> doneChunks;
+
+	bool isFinished() const {
+		return doneChunks.load() == chunkCount;
+	}
+
+	//Takes chunks until there are none left
+	void run() {
+		ActiveJob active = {this, currentJobs};
+		currentJobs = &active;
+
+		int slot = -1;
+		size_t done = 0;
+		while (true) {
+			size_t chunk = nextChunk.fetch_add(1);
+			if (chunk >= chunkCount) {
+				break;
+			}
+			if (slot == -1) {
+				slot = nextSlot.fetch_add(1);
+			}
+			size_t begin = chunk * chunkSize;
+			size_t end = begin + chunkSize;
+			if (end > count) {
+				end = count;
+			}
+			body(begin, end, slot);
+			done ++;
+		}
+
+		currentJobs = active.next;
+
+		//Whoever finishes the last chunk lets the waiting caller know
+		if (done > 0 && doneChunks.fetch_add(done) + done == chunkCount) {
+			pool->signal();
+		}
+	}
+};
+
+ThreadPool::ThreadPool(int threadCount) : generation(0), stopping(false) {
+	if (threadCount <= 0) {
+		threadCount = getDefaultThreadCount();
+	}
+	//One queue per worker plus one for everybody else
+	for (int i = 0; i < threadCount; i ++) {
+		queues.push_back(std::unique_ptr<WorkQueue>(new WorkQueue()));
+	}
+	for (int i = 1; i < threadCount; i ++) {
+		workers.push_back(std::thread(&ThreadPool::workerMain, this, i - 1));
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> guard(sleepLock);
+		stopping = true;
+		generation ++;
+	}
+	wake.notify_all();
+	for (size_t i = 0; i < workers.size(); i ++) {
+		workers[i].join();
+	}
+}
+
+int ThreadPool::getThreadCount() const {
+	return (int)workers.size() + 1;
+}
+
+void ThreadPool::forRange(ThreadPool *pool, size_t count, size_t chunkSize, const std::function<void(size_t, size_t, int)> &body) {
+	if (pool == NULL) {
+		if (count > 0) {
+			body(0, count, 0);
+		}
+		return;
+	}
+	pool->parallelFor(count, chunkSize, body);
+}
+
+int ThreadPool::getSlotCount(const ThreadPool *pool) {
+	return (pool == NULL ? 1 : pool->getThreadCount());
+}
+
+int ThreadPool::getDefaultThreadCount() {
+	int cores = (int)std::thread::hardware_concurrency();
+	return (cores > 0 ? cores : 1);
+}
+
+int ThreadPool::getQueueIndex() const {
+	return (currentPool == this ? currentQueue : (int)workers.size());
+}
+
+//Wakes everyone who is waiting for something to change
+void ThreadPool::signal() {
+	{
+		std::lock_guard<std::mutex> guard(sleepLock);
+		generation ++;
+	}
+	wake.notify_all();
+}
+
+void ThreadPool::push(const Task &task) {
+	WorkQueue &queue = *queues[getQueueIndex()];
+	{
+		std::lock_guard<std::mutex> guard(queue.lock);
+		queue.tasks.push_back(task);
+	}
+	signal();
+}
+
+//Finds something for the thread that owns queue index to do. Its own newest task comes first,
+//since that's the one most likely to still be in cache, then the oldest task of anyone else's.
+bool ThreadPool::takeTask(int index, Task &task) {
+	{
+		WorkQueue &queue = *queues[index];
+		std::lock_guard<std::mutex> guard(queue.lock);
+		for (size_t i = queue.tasks.size(); i > 0; i --) {
+			if (!isActive(queue.tasks[i - 1].job)) {
+				task = std::move(queue.tasks[i - 1]);
+				queue.tasks.erase(queue.tasks.begin() + (i - 1));
+				return true;
+			}
+		}
+	}
+	for (size_t offset = 1; offset < queues.size(); offset ++) {
+		WorkQueue &queue = *queues[(index + offset) % queues.size()];
+		std::lock_guard<std::mutex> guard(queue.lock);
+		for (size_t i = 0; i < queue.tasks.size(); i ++) {
+			if (!isActive(queue.tasks[i].job)) {
+				task = std::move(queue.tasks[i]);
+				queue.tasks.erase(queue.tasks.begin() + i);
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+void ThreadPool::workerMain(int index) {
+	currentPool = this;
+	currentQueue = index;
+
+	while (true) {
+		unsigned seen = generation.load();
+		Task task;
+		if (takeTask(index, task)) {
+			task.run();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> guard(sleepLock);
+		//Nothing left anywhere, so it's safe to stop
+		if (stopping) {
+			return;
+		}
+		while (generation.load() == seen && !stopping) {
+			wake.wait(guard);
+		}
+	}
+}
+
+void ThreadPool::submit(const std::function<void()> &task) {
+	if (workers.empty()) {
+		task();
+		return;
+	}
+	Task entry = {task, NULL};
+	push(entry);
+}
+
+void ThreadPool::parallelFor(size_t count, size_t chunkSize, const std::function<void(size_t, size_t, int)> &body) {
+	if (count == 0) {
+		return;
+	}
+	if (chunkSize == 0) {
+		chunkSize = 1;
+	}
+
+	std::shared_ptr<ParallelJob> job = std::make_shared<ParallelJob>();
+	job->pool = this;
+	job->count = count;
+	job->chunkSize = chunkSize;
+	job->chunkCount = (count + chunkSize - 1) / chunkSize;
+	job->body = body;
+	job->nextChunk = 0;
+	job->nextSlot = 0;
+	job->doneChunks = 0;
+
+	//No point waking more helpers than there are chunks for
+	size_t helpers = job->chunkCount - 1;
+	if (helpers > workers.size()) {
+		helpers = workers.size();
+	}
+	for (size_t i = 0; i < helpers; i ++) {
+		Task helper = {[job]() {
+			job->run();
+		}, job.get()};
+		push(helper);
+	}
+
+	job->run();
+
+	//Other threads may still be on their last chunks. Rather than sit idle, help with whatever
+	//else is queued until they're done.
+	int index = getQueueIndex();
+	while (!job->isFinished()) {
+		unsigned seen = generation.load();
+		Task task;
+		if (takeTask(index, task)) {
+			task.run();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> guard(sleepLock);
+		while (!job->isFinished() && generation.load() == seen) {
+			wake.wait(guard);
+		}
+	}
+}
@@ -0,0 +1,98 @@
+//
+//  threadpool.h
+//  MBMapSplitter
+//
+//  Copyright (c) 2015 HiGuy Smith
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#ifndef __MBMapSplitter__threadpool__
+#define __MBMapSplitter__threadpool__
+
+#include <stddef.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct ParallelJob;
+
+//A fixed set of worker threads. The thread that hands out work always does its share too, so a
+//pool of N threads starts N - 1 workers, and a pool of 1 runs everything on the caller.
+//Every worker has its own queue: it pushes and pops its own tasks at the back, and when it runs
+//out it steals from the front of someone else's. Threads that aren't workers share one extra
+//queue. A thread waiting on a parallelFor doesn't sleep while there's work around, it runs other
+//tasks in the meantime, so parallelFor can be nested as deep as you like (say, one task per map
+//with each map splitting up its own work) without tying up threads.
+class ThreadPool {
+	struct Task {
+		std::function<void()> run;
+		const ParallelJob *job;
+	};
+	struct WorkQueue {
+		std::mutex lock;
+		std::deque<Task> tasks;
+	};
+
+	std::vector<std::thread> workers;
+	std::vector<std::unique_ptr<WorkQueue> > queues;
+	std::mutex sleepLock;
+	std::condition_variable wake;
+	std::atomic<unsigned> generation;
+	bool stopping;
+
+	void workerMain(int index);
+	int getQueueIndex() const;
+	void push(const Task &task);
+	bool takeTask(int index, Task &task);
+	void signal();
+	friend struct ParallelJob;
+
+	ThreadPool(const ThreadPool &other) = delete;
+	ThreadPool &operator=(const ThreadPool &other) = delete;
+public:
+	//0 threads means one per core
+	ThreadPool(int threadCount = 0);
+	~ThreadPool();
+
+	int getThreadCount() const;
+
+	//Queues a task for the workers
+	void submit(const std::function<void()> &task);
+
+	//Runs body(begin, end, slot) over [0, count) in chunks of at most chunkSize, and returns once
+	//every chunk is done. Chunks are handed out in any order. slot is unique among the threads
+	//working on this call at the same time and less than getThreadCount(), so it can index
+	//per-thread scratch space.
+	void parallelFor(size_t count, size_t chunkSize, const std::function<void(size_t, size_t, int)> &body);
+
+	//The same, for code that can be handed a NULL pool: then body runs over all of [0, count) at
+	//once on the calling thread, as slot 0
+	static void forRange(ThreadPool *pool, size_t count, size_t chunkSize, const std::function<void(size_t, size_t, int)> &body);
+	//How many slots forRange can hand out on pool: its thread count, or 1 for NULL
+	static int getSlotCount(const ThreadPool *pool);
+
+	static int getDefaultThreadCount();
+};
+
+#endif
@@ -27,7 +27,7 @@ extern "C" {
 }
 
 #include <stdio.h>
-#include "aabbcolor.h"
+#include "mapsplitter.h"
 
 #include <string>
 #include <vector>
@@ -36,80 +36,6 @@ extern "C" {
 #include <fstream>
 #include <algorithm>
 
-AABB getBrushAABB(const std::string input) {
-	//Find all points within ()
-
-	std::vector<std::string> verts;
-
-	bool inVert = false;
-	std::string currentVert;
-
-	for (int i = 0; i < input.length(); i ++) {
-		char cur = input[i];
-		if (cur == '(') {
-			inVert = true;
-			currentVert.clear();
-			continue;
-		}
-		if (cur == ')') {
-			inVert = false;
-			verts.push_back(currentVert);
-			continue;
-		}
-		if (inVert) {
-			currentVert += cur;
-		}
-	}
-
-	//Now that we have the verts, AABB em
-	double aabb[6];
-	aabb[0] = INT_MAX;
-	aabb[1] = INT_MAX;
-	aabb[2] = INT_MAX;
-	aabb[3] = INT_MIN;
-	aabb[4] = INT_MIN;
-	aabb[5] = INT_MIN;
-
-	for (int i = 0; i < verts.size(); i ++) {
-		std::string vert = verts[i];
-
-		std::string buf;
-		std::stringstream stream(vert);
-		std::vector<std::string> tokens;
-
-		while (stream >> buf) {
-			tokens.push_back(buf);
-		}
-
-		aabb[0] = MIN(aabb[0], atof(tokens[0].c_str()));
-		aabb[1] = MIN(aabb[1], atof(tokens[1].c_str()));
-		aabb[2] = MIN(aabb[2], atof(tokens[2].c_str()));
-		aabb[3] = MAX(aabb[3], atof(tokens[0].c_str()));
-		aabb[4] = MAX(aabb[4], atof(tokens[1].c_str()));
-		aabb[5] = MAX(aabb[5], atof(tokens[2].c_str()));
-	}
-
-	return AABB(aabb[0], aabb[1], aabb[2], aabb[3], aabb[4], aabb[5]);
-}
-
-std::string readFile(const char *path) {
-	std::string conts;
-	std::ifstream stream;
-	stream.open(path);
-
-	if (!stream.is_open()) {
-		return std::string();
-	}
-	std::string line;
-	while (getline(stream, line, '\n')) {
-		conts.append(line);
-		conts.append("\n");
-	}
-	stream.close();
-
-	return conts;
-}
-
 void convertPath(std::string &path) {
 	std::replace(path.begin(), path.end(), '\\', '/');
 }
@@ -140,10 +66,6 @@ void printUsage(const char *executable) {
 	std::cout << "Usage: " << executable << " <map file> [-e export file [-p prefix]]" << std::endl;
 }
 
-void writeCstring(std::ostream &stream, const char *string) {
-	stream.write(string, strlen(string));
-}
-
 @interface Document ()
 
 @end
@@ -200,90 +122,42 @@ static BOOL gOneShot = NO, gSetOneShot = NO;
 	const char *mapfile = [[url path] UTF8String];
 
 	//Read the map
-	std::string mapConts = readFile(mapfile);
-	if (mapConts.length() == 0) {
+	MapFile mapFile;
+	if (!mapFile.open(mapfile)) {
 		std::cout << "Invalid input file " << mapfile << std::endl;
 		return NO;
 	}
 
-	//Split it into pieces
-	std::string header;
-	std::string currentBrush;
-	std::vector<AABB> AABBs;
-	std::vector<std::string> brushes;
-
-	int inGroups = 0;
-	bool foundHeader = false;
-
-	for (int i = 0; i < mapConts.length(); i ++) {
-		char cur = mapConts[i];
-		if (cur == '{') {
-			inGroups ++;
-
-			//Worldspawn group start
-			if (inGroups == 1) {
-				continue;
-			}
-
-			foundHeader = true;
-
-			currentBrush.clear();
-		}
-		if (inGroups == 1 && !foundHeader) {
-			header += cur;
-		}
-		if (inGroups == 2) {
-			currentBrush += cur;
-		}
-		if (cur == '}') {
-			inGroups --;
-			if (inGroups < 0) {
-				std::cout << "Mismatched end brace in " << mapfile << std::endl;
-				return NO;
-			}
-			//End of brush
-			if (inGroups == 1) {
-				brushes.push_back(currentBrush);
-				AABBs.push_back(getBrushAABB(currentBrush));
-			}
-		}
-	}
+	//Split algorithm by Whirligig231
+	ThreadPool pool;
+	SplitOptions options;
+	options.pool = &pool;
 
-	std::cout << "Found " << brushes.size() << " brushes." << std::endl;
+	MapSplit split;
+	if (splitMapText(mapFile.getData(), mapFile.getLength(), options, split) == SplitMismatchedBrace) {
+		std::cout << "Mismatched end brace in " << mapfile << std::endl;
+		return NO;
+	}
 
-	//Split algorithm by Whirligig231
-	Graph graph = getCollisions(AABBs);
-	graph.colorDSATUR();
+	std::cout << "Found " << split.getBrushes().size() << " brushes." << std::endl;
 
 	//Export sets
-	int **colorSets = graph.getColorSets();
-	for (int i = 0; colorSets[i] != NULL; i ++) {
+	std::vector<std::string> paths;
+	for (size_t i = 0; i < split.getPartCount(); i ++) {
 		// path/to/mapname-0.map
 		std::string path(mapfile);
 		path = stripExt(path);
 		path += "-";
 		path += std::to_string(i); //C++11
 		path += ".map";
+		paths.push_back(path);
+	}
 
-		//Write map
-		std::ofstream output;
-		output.open(path);
-		if (!output.is_open()) {
-			std::cout << "Could not write split map, error with " << path << std::endl;
-			return NO;
-		}
-
-		output.put('{');
-		writeCstring(output, header.c_str());
-
-		//Write each brush from the set
-		for (int j = 0; colorSets[i][j] != -1; j ++) {
-			writeCstring(output, brushes[colorSets[i][j]].c_str());
-			writeCstring(output, "\r\n");
-		}
-
-		output.put('}');
-		output.close();
+	//Write maps
+	int failed = writeSplitMaps(split.getData(), split.getHeader(), split.getBrushes(), split.getParts(), paths, pool);
+	if (failed != -1) {
+		std::cout << "Could not write split map, error with " << paths[failed] << std::endl;
+		return NO;
 	}
 
 	const char *cspath = [[url URLByDeletingPathExtension] URLByAppendingPathExtension:@"cs"].path.UTF8String;
@@ -302,21 +176,7 @@ static BOOL gOneShot = NO, gSetOneShot = NO;
 
 	convertPath(path);
 
-	for (int i = 0; colorSets[i] != NULL; i ++) {
-		writeCstring(output, "   new InteriorInstance() {\n"
-					 "      position = \"0 0 0\";\n"
-					 "      rotation = \"1 0 0 0\";\n"
-					 "      scale = \"1 1 1\";\n");
-
-		//   interiorFile = "<path/to/>Mapname-0.dif";
-		writeCstring(output, "      interiorFile = \"");
-		writeCstring(output, path.c_str());
-		writeCstring(output, "-");
-		writeCstring(output, std::to_string(i).c_str());
-		writeCstring(output, ".dif\";\n");
-		writeCstring(output, "      showTerrainInside = \"1\";\n");
-		writeCstring(output, "   };\n");
-	}
+	writeInteriorExports(output, path, split.getPartCount());
 	output.close();
 
 	return YES;
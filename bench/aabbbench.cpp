@@ -0,0 +1,168 @@
+//
+//  aabbbench.cpp
+//  MBMapSplitter benchmarks
+//
+//  Copyright (c) 2015 HiGuy Smith
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+//Times getBrushAABB against the stringstream version it replaced, on synthetic box brushes.
+//Usage: aabbbench [brush count] [rounds]
+
+#include "mapfile.h"
+
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+//The original getBrushAABB, kept here to compare against
+static AABB legacyBrushAABB(const std::string input) {
+	std::vector<std::string> verts;
+
+	bool inVert = false;
+	std::string currentVert;
+
+	for (size_t i = 0; i < input.length(); i ++) {
+		char cur = input[i];
+		if (cur == '(') {
+			inVert = true;
+			currentVert.clear();
+			continue;
+		}
+		if (cur == ')') {
+			inVert = false;
+			verts.push_back(currentVert);
+			continue;
+		}
+		if (inVert) {
+			currentVert += cur;
+		}
+	}
+
+	double aabb[6];
+	aabb[0] = INT_MAX;
+	aabb[1] = INT_MAX;
+	aabb[2] = INT_MAX;
+	aabb[3] = INT_MIN;
+	aabb[4] = INT_MIN;
+	aabb[5] = INT_MIN;
+
+	for (size_t i = 0; i < verts.size(); i ++) {
+		std::string vert = verts[i];
+
+		std::string buf;
+		std::stringstream stream(vert);
+		std::vector<std::string> tokens;
+
+		while (stream >> buf) {
+			tokens.push_back(buf);
+		}
+
+		aabb[0] = MIN(aabb[0], atof(tokens[0].c_str()));
+		aabb[1] = MIN(aabb[1], atof(tokens[1].c_str()));
+		aabb[2] = MIN(aabb[2], atof(tokens[2].c_str()));
+		aabb[3] = MAX(aabb[3], atof(tokens[0].c_str()));
+		aabb[4] = MAX(aabb[4], atof(tokens[1].c_str()));
+		aabb[5] = MAX(aabb[5], atof(tokens[2].c_str()));
+	}
+
+	return AABB(aabb[0], aabb[1], aabb[2], aabb[3], aabb[4], aabb[5]);
+}
+
+//A six sided box brush the way map editors write them
+static std::string makeBrush(double x, double y, double z, double sx, double sy, double sz) {
+	char buf[1024];
+	double x2 = x + sx, y2 = y + sy, z2 = z + sz;
+	snprintf(buf, sizeof(buf),
+	         "{\n"
+	         "( %g %g %g ) ( %g %g %g ) ( %g %g %g ) tex 0 0 0 1 1\r\n"
+	         "( %g %g %g ) ( %g %g %g ) ( %g %g %g ) tex 0 0 0 1 1\r\n"
+	         "( %g %g %g ) ( %g %g %g ) ( %g %g %g ) tex 0 0 0 1 1\r\n"
+	         "( %g %g %g ) ( %g %g %g ) ( %g %g %g ) tex 0 0 0 1 1\r\n"
+	         "( %g %g %g ) ( %g %g %g ) ( %g %g %g ) tex 0 0 0 1 1\r\n"
+	         "( %g %g %g ) ( %g %g %g ) ( %g %g %g ) tex 0 0 0 1 1\r\n"
+	         "}",
+	         x, y2, z2, x2, y2, z2, x2, y, z2,
+	         x, y, z, x2, y, z, x2, y2, z,
+	         x, y2, z2, x, y, z2, x, y, z,
+	         x2, y2, z, x2, y, z, x2, y, z2,
+	         x2, y2, z2, x, y2, z2, x, y2, z,
+	         x2, y, z, x, y, z, x, y, z2);
+	return std::string(buf);
+}
+
+static double seconds(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, const char **argv) {
+	int count = (argc > 1 ? atoi(argv[1]) : 100000);
+	int rounds = (argc > 2 ? atoi(argv[2]) : 3);
+
+	srand(1);
+	std::vector<std::string> brushes;
+	brushes.reserve(count);
+	for (int i = 0; i < count; i ++) {
+		brushes.push_back(makeBrush((rand() % 200000) / 10.0 - 10000, (rand() % 200000) / 10.0 - 10000, (rand() % 20000) / 10.0,
+		                            8 << (rand() % 5), 8 << (rand() % 5), 8 << (rand() % 3)));
+	}
+
+	//Both had better agree before we time anything
+	for (int i = 0; i < count; i ++) {
+		AABB legacy = legacyBrushAABB(brushes[i]);
+		AABB fast = getBrushAABB(brushes[i].data(), brushes[i].length());
+		for (int axis = 0; axis < 3; axis ++) {
+			if (legacy.getMin(axis) != fast.getMin(axis) || legacy.getMax(axis) != fast.getMax(axis)) {
+				printf("Results differ on brush %d!\n", i);
+				return 1;
+			}
+		}
+	}
+
+	double legacyTime = 0, fastTime = 0;
+	//Summed and printed so neither loop can be optimized away
+	double sink = 0;
+	for (int round = 0; round < rounds; round ++) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int i = 0; i < count; i ++) {
+			sink += legacyBrushAABB(brushes[i]).getMin(0);
+		}
+		legacyTime += seconds(start);
+
+		start = std::chrono::steady_clock::now();
+		for (int i = 0; i < count; i ++) {
+			sink += getBrushAABB(brushes[i].data(), brushes[i].length()).getMin(0);
+		}
+		fastTime += seconds(start);
+	}
+
+	double total = (double)count * rounds;
+	printf("getBrushAABB, %d brushes x %d rounds\n", count, rounds);
+	printf("  stringstream: %12.0f brushes/s\n", total / legacyTime);
+	printf("  in place:     %12.0f brushes/s (%.1fx)\n", total / fastTime, legacyTime / fastTime);
+	printf("  (checksum %g)\n", sink);
+	return 0;
+}
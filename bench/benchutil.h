@@ -0,0 +1,80 @@
+//
+//  benchutil.h
+//  MBMapSplitter benchmarks
+//
+//  Copyright (c) 2015 HiGuy Smith
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#ifndef __MBMapSplitter__benchutil__
+#define __MBMapSplitter__benchutil__
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/resource.h>
+
+//Little things every benchmark wants: a stopwatch and a way to see how much memory we used
+
+inline double seconds(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+//Starts counting peak memory over again from what's in use now. Only Linux can do this, everywhere
+//else the peak is for the whole run so far.
+inline void resetPeakMemory() {
+#ifdef __linux__
+	FILE *refs = fopen("/proc/self/clear_refs", "w");
+	if (refs != NULL) {
+		fputs("5", refs);
+		fclose(refs);
+	}
+#endif
+}
+
+//Peak resident memory in bytes since the last reset
+inline double getPeakMemory() {
+#ifdef __linux__
+	FILE *status = fopen("/proc/self/status", "r");
+	if (status != NULL) {
+		char line[256];
+		double peak = -1;
+		while (fgets(line, sizeof(line), status) != NULL) {
+			if (!strncmp(line, "VmHWM:", 6)) {
+				peak = atof(line + 6) * 1024.0;
+				break;
+			}
+		}
+		fclose(status);
+		if (peak >= 0) {
+			return peak;
+		}
+	}
+#endif
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+	return (double)usage.ru_maxrss; //Bytes here, kilobytes everywhere else
+#else
+	return usage.ru_maxrss * 1024.0;
+#endif
+}
+
+#endif
@@ -0,0 +1,85 @@
+//
+//  collisionbench.cpp
+//  MBMapSplitter benchmarks
+//
+//  Copyright (c) 2015 HiGuy Smith
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+//Times getCollisions on random boxes with 1, 2, 4, ... threads and checks they all find the same
+//edges. Usage: collisionbench [box count] [max threads] [auto|brute|sweep|grid]
+
+#include "aabbcolor.h"
+#include "aabbstore.h"
+#include "broadphase.h"
+#include "threadpool.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+int main(int argc, const char **argv) {
+	int count = (argc > 1 ? atoi(argv[1]) : 200000);
+	int maxThreads = (argc > 2 ? atoi(argv[2]) : 32);
+	BroadPhase method = BroadPhaseAuto;
+	if (argc > 3) {
+		if (!strcmp(argv[3], "brute")) method = BroadPhaseBruteForce;
+		if (!strcmp(argv[3], "sweep")) method = BroadPhaseSweep;
+		if (!strcmp(argv[3], "grid"))  method = BroadPhaseGrid;
+	}
+
+	//Boxes scattered over a level about as dense as a big custom map
+	srand(1);
+	double side = 100.0 * sqrt((double)count);
+	std::vector<AABB> AABBs;
+	AABBs.reserve(count);
+	for (int i = 0; i < count; i ++) {
+		double x = (rand() / (double)RAND_MAX) * side;
+		double y = (rand() / (double)RAND_MAX) * side / 4;
+		double z = (rand() / (double)RAND_MAX) * 256;
+		AABBs.push_back(AABB(x, y, z, x + (8 << (rand() % 6)), y + (8 << (rand() % 6)), z + (8 << (rand() % 4))));
+	}
+
+	printf("getCollisions, %d boxes, %s kernel\n", count, AABBStore::getKernelName());
+	printf("%8s %12s %12s %10s\n", "threads", "edges", "seconds", "speedup");
+
+	std::vector<std::pair<int, int> > reference;
+	double baseTime = 0;
+	for (int threads = 1; threads <= maxThreads; threads *= 2) {
+		ThreadPool pool(threads);
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		std::vector<std::pair<int, int> > pairs;
+		findOverlaps(AABBs, method, pairs, &pool);
+		Graph graph((int)AABBs.size(), pairs);
+		double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		if (threads == 1) {
+			reference = pairs;
+			baseTime = time;
+		} else if (pairs != reference) {
+			printf("Edges differ with %d threads!\n", threads);
+			return 1;
+		}
+		printf("%8d %12d %12.3f %9.2fx\n", threads, graph.getEdgeCount(), time, baseTime / time);
+	}
+	return 0;
+}
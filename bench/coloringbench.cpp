@@ -0,0 +1,166 @@
+//
+//  coloringbench.cpp
+//  MBMapSplitter benchmarks
+//
+//  Copyright (c) 2015 HiGuy Smith
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+//Colors a synthetic map's collision graph with DSATUR, then with colorComponents and
+//colorParallel on 1, 2, 4, ... threads, and compares the time and the number of colors. Every
+//coloring is checked to be valid and the same as on one thread, and colorComponents to need
+//exactly as many colors as DSATUR.
+//Usage: coloringbench [-n brushes] [-d density] [-l uniform|clustered|corridor|grid] [-s seed]
+//                     [-t max threads] [-r rounds]
+//Without -n it runs a 100k and a 1M brush map.
+
+#include "aabbcolor.h"
+#include "benchutil.h"
+#include "coloring.h"
+#include "mapfile.h"
+#include "synthmap.h"
+#include "threadpool.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static void printUsage(const char *executable) {
+	std::cout << "Usage: " << executable << " [-n brushes] [-d density] [-l uniform|clustered|corridor|grid] [-s seed] [-t max threads] [-r rounds]" << std::endl;
+}
+
+static bool isValid(const CSRGraph &graph, const std::vector<int> &colors) {
+	for (int i = 0; i < graph.getNodeCount(); i ++) {
+		for (size_t edge = graph.getOffsets()[i]; edge < graph.getOffsets()[i + 1]; edge ++) {
+			if (colors[graph.getTargets()[edge]] == colors[i]) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static bool runBenchmark(const SynthMapOptions &options, int maxThreads, int rounds) {
+	std::string map;
+	generateMap(options, map);
+	std::vector<MapSpan> header;
+	std::vector<MapSpan> brushes;
+	tokenizeMap(map.data(), map.size(), header, brushes);
+	ThreadPool buildPool(maxThreads);
+	std::vector<AABB> AABBs;
+	getBrushAABBs(map.data(), brushes, AABBs, buildPool);
+	Graph graph = getCollisions(std::move(AABBs), BroadPhaseAuto, &buildPool);
+	const CSRGraph &adjacency = graph.getAdjacency();
+	int count = adjacency.getNodeCount();
+
+	printf("%d brushes, %s, density %.1f, seed %llu, %d edges, best of %d\n", count, getLayoutName(options.layout), options.density, (unsigned long long)options.seed, graph.getEdgeCount(), rounds);
+	printf("  %-16s %8s %10s %10s\n", "coloring", "colors", "seconds", "speedup");
+
+	std::vector<int> colors(count);
+	double serialTime = 0;
+	int serialColors = 0;
+	for (int round = 0; round < rounds; round ++) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		serialColors = colorDSATUR(count, adjacency.getOffsets(), adjacency.getTargets(), &colors[0]);
+		double time = seconds(start);
+		serialTime = (round == 0 ? time : std::min(serialTime, time));
+	}
+	printf("  %-16s %8d %10.4f %9.2fx\n", "DSATUR", serialColors, serialTime, 1.0);
+
+	for (int method = 0; method < 2; method ++) {
+		std::vector<int> reference;
+		for (int threads = 1; threads <= maxThreads; threads *= 2) {
+			ThreadPool pool(threads);
+			double best = 0;
+			int colorCount = 0;
+			for (int round = 0; round < rounds; round ++) {
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				if (method == 0) {
+					colorCount = colorComponents(count, adjacency.getOffsets(), adjacency.getTargets(), &colors[0], &pool);
+				} else {
+					colorCount = colorParallel(count, adjacency.getOffsets(), adjacency.getTargets(), &colors[0], &pool, (unsigned)options.seed);
+				}
+				double time = seconds(start);
+				best = (round == 0 ? time : std::min(best, time));
+			}
+			const char *name = (method == 0 ? "components" : "parallel");
+			if (!isValid(adjacency, colors)) {
+				printf("Invalid %s coloring with %d threads!\n", name, threads);
+				return false;
+			}
+			if (method == 0 && colorCount != serialColors) {
+				printf("Components used %d colors, DSATUR %d!\n", colorCount, serialColors);
+				return false;
+			}
+			if (threads == 1) {
+				reference = colors;
+			} else if (colors != reference) {
+				printf("%s colors differ with %d threads!\n", name, threads);
+				return false;
+			}
+			char label[32];
+			snprintf(label, sizeof(label), "%s x%d", name, threads);
+			printf("  %-16s %8d %10.4f %9.2fx\n", label, colorCount, best, serialTime / best);
+		}
+	}
+	printf("\n");
+	return true;
+}
+
+int main(int argc, const char **argv) {
+	SynthMapOptions options;
+	bool haveCount = false;
+	int maxThreads = ThreadPool::getDefaultThreadCount();
+	int rounds = 3;
+
+	for (int i = 1; i < argc; i += 2) {
+		if (i + 1 >= argc) {
+			printUsage(argv[0]);
+			return 1;
+		}
+		if (!strcmp(argv[i], "-t") && atoi(argv[i + 1]) > 0) {
+			maxThreads = atoi(argv[i + 1]);
+		} else if (!strcmp(argv[i], "-r") && atoi(argv[i + 1]) > 0) {
+			rounds = atoi(argv[i + 1]);
+		} else if (parseSynthOption(argv[i], argv[i + 1], options)) {
+			haveCount = haveCount || !strcmp(argv[i], "-n");
+		} else {
+			printUsage(argv[0]);
+			return 1;
+		}
+	}
+
+	std::vector<int> counts;
+	if (haveCount) {
+		counts.push_back(options.brushCount);
+	} else {
+		counts.push_back(100000);
+		counts.push_back(1000000);
+	}
+	for (size_t i = 0; i < counts.size(); i ++) {
+		options.brushCount = counts[i];
+		if (!runBenchmark(options, maxThreads, rounds)) {
+			return 2;
+		}
+	}
+	return 0;
+}
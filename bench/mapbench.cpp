@@ -0,0 +1,258 @@
+//
+//  mapbench.cpp
+//  MBMapSplitter benchmarks
+//
+//  Copyright (c) 2015 HiGuy Smith
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+//Runs every stage of splitting a synthetic map, one at a time, and reports how long each took,
+//how fast it went, and how much memory it peaked at.
+//Usage: mapbench [-n brushes] [-d density] [-l uniform|clustered|corridor|grid] [-f faces]
+//                [-s seed] [-t threads] [-c auto|brute|sweep|grid] [-r rounds] [-o scratch dir]
+//Without -n it runs 1k, 10k and 100k brush maps in turn. Pass -n 1000000 for the big one.
+
+#include "aabbcolor.h"
+#include "aabbstore.h"
+#include "benchutil.h"
+#include "mapfile.h"
+#include "synthmap.h"
+#include "threadpool.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+struct Stage {
+	const char *name;
+	double seconds;
+	double peak;
+	double amount; //How much it got through, in units
+	const char *units;
+};
+
+static void printUsage(const char *executable) {
+	std::cout << "Usage: " << executable << " [-n brushes] [-d density] [-l uniform|clustered|corridor|grid] [-f faces] [-s seed] [-t threads] [-c auto|brute|sweep|grid] [-r rounds] [-o scratch dir]" << std::endl;
+}
+
+static bool parseBroadPhase(const char *name, BroadPhase &method) {
+	const char *names[] = {"auto", "brute", "sweep", "grid"};
+	for (int i = 0; i < 4; i ++) {
+		if (!strcmp(name, names[i])) {
+			method = (BroadPhase)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+//Keeps the best time (and the highest peak) of every round
+static void record(std::vector<Stage> &stages, size_t index, const Stage &stage) {
+	if (index >= stages.size()) {
+		stages.push_back(stage);
+		return;
+	}
+	if (stage.seconds < stages[index].seconds) {
+		stages[index].seconds = stage.seconds;
+	}
+	if (stage.peak > stages[index].peak) {
+		stages[index].peak = stage.peak;
+	}
+}
+
+static bool runBenchmark(const SynthMapOptions &options, BroadPhase method, ThreadPool &pool, int rounds, const std::string &scratch) {
+	std::string map;
+	generateMap(options, map);
+
+	//The map goes through a real file so loading it is measured the way the splitter does it
+	std::string base = scratch + "/mapbench-" + std::to_string((long long)getpid());
+	std::string mapPath = base + ".map";
+	{
+		std::ofstream output;
+		output.open(mapPath.c_str(), std::ios::out | std::ios::binary);
+		if (!output.is_open()) {
+			std::cout << "Could not write " << mapPath << std::endl;
+			return false;
+		}
+		output.write(map.data(), map.size());
+	}
+	double mapBytes = (double)map.size();
+	std::string().swap(map);
+
+	printf("%d brushes, %s, density %.1f, %d faces, seed %llu\n", options.brushCount, getLayoutName(options.layout), options.density, options.faces, (unsigned long long)options.seed);
+	printf("  %.1f MB map, %d threads, %s kernel, best of %d\n", mapBytes / 1048576.0, pool.getThreadCount(), AABBStore::getKernelName(), rounds);
+
+	std::vector<Stage> stages;
+	int edges = 0, colors = 0;
+	double outputBytes = 0;
+	std::vector<std::string> paths;
+
+	for (int round = 0; round < rounds; round ++) {
+		size_t index = 0;
+
+		resetPeakMemory();
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		MapFile mapFile;
+		if (!mapFile.open(mapPath.c_str())) {
+			std::cout << "Could not read " << mapPath << std::endl;
+			remove(mapPath.c_str());
+			return false;
+		}
+		//Mapping is free, it's touching the pages that costs
+		volatile char sink = 0;
+		for (size_t i = 0; i < mapFile.getLength(); i += 4096) {
+			sink ^= mapFile.getData()[i];
+		}
+		Stage load = {"load", seconds(start), getPeakMemory(), mapBytes / 1048576.0, "MB"};
+		record(stages, index ++, load);
+
+		resetPeakMemory();
+		start = std::chrono::steady_clock::now();
+		std::vector<MapSpan> header;
+		std::vector<MapSpan> brushes;
+		tokenizeMap(mapFile.getData(), mapFile.getLength(), header, brushes);
+		Stage tokenize = {"tokenizeMap", seconds(start), getPeakMemory(), mapBytes / 1048576.0, "MB"};
+		record(stages, index ++, tokenize);
+
+		resetPeakMemory();
+		start = std::chrono::steady_clock::now();
+		std::vector<AABB> AABBs;
+		getBrushAABBs(mapFile.getData(), brushes, AABBs, pool);
+		Stage bounds = {"getBrushAABB", seconds(start), getPeakMemory(), (double)brushes.size(), "brushes"};
+		record(stages, index ++, bounds);
+
+		resetPeakMemory();
+		start = std::chrono::steady_clock::now();
+		Graph graph = getCollisions(std::move(AABBs), method, &pool);
+		Stage collisions = {"getCollisions", seconds(start), getPeakMemory(), (double)brushes.size(), "brushes"};
+		record(stages, index ++, collisions);
+		edges = graph.getEdgeCount();
+
+		resetPeakMemory();
+		start = std::chrono::steady_clock::now();
+		graph.colorDSATUR();
+		Stage color = {"colorDSATUR", seconds(start), getPeakMemory(), (double)brushes.size(), "brushes"};
+		record(stages, index ++, color);
+
+		resetPeakMemory();
+		start = std::chrono::steady_clock::now();
+		Partition colorSets = graph.getPartition();
+		Stage sets = {"getPartition", seconds(start), getPeakMemory(), (double)brushes.size(), "brushes"};
+		record(stages, index ++, sets);
+
+		paths.clear();
+		colors = (int)colorSets.getClassCount();
+		for (int i = 0; i < colors; i ++) {
+			paths.push_back(base + "-" + std::to_string((long long)i) + ".map");
+		}
+		outputBytes = 0;
+		for (int i = 0; i < colors; i ++) {
+			outputBytes += 2;
+			PartitionClass set = colorSets.getClass(i);
+			for (size_t j = 0; j < set.size(); j ++) {
+				outputBytes += brushes[set[j]].length + 2;
+			}
+		}
+		for (size_t i = 0; i < header.size(); i ++) {
+			outputBytes += (double)header[i].length * colors;
+		}
+
+		resetPeakMemory();
+		start = std::chrono::steady_clock::now();
+		int failed = writeSplitMaps(mapFile.getData(), header, brushes, colorSets, paths, pool);
+		Stage write = {"writeSplitMaps", seconds(start), getPeakMemory(), outputBytes / 1048576.0, "MB"};
+		record(stages, index ++, write);
+
+		for (size_t i = 0; i < paths.size(); i ++) {
+			remove(paths[i].c_str());
+		}
+		if (failed != -1) {
+			std::cout << "Could not write " << paths[failed] << std::endl;
+			remove(mapPath.c_str());
+			return false;
+		}
+	}
+	remove(mapPath.c_str());
+
+	printf("  %-16s %10s %22s %14s\n", "stage", "seconds", "throughput", "peak memory");
+	double total = 0;
+	for (size_t i = 0; i < stages.size(); i ++) {
+		char throughput[64];
+		snprintf(throughput, sizeof(throughput), "%.1f %s/s", stages[i].amount / stages[i].seconds, stages[i].units);
+		printf("  %-16s %10.4f %22s %11.1f MB\n", stages[i].name, stages[i].seconds, throughput, stages[i].peak / 1048576.0);
+		total += stages[i].seconds;
+	}
+	printf("  %-16s %10.4f %22.1f\n", "total", total, options.brushCount / total);
+	printf("  %d edges, %d colors\n\n", edges, colors);
+	return true;
+}
+
+int main(int argc, const char **argv) {
+	SynthMapOptions options;
+	bool haveCount = false;
+	BroadPhase method = BroadPhaseAuto;
+	int threads = 0;
+	int rounds = 3;
+	const char *tmp = getenv("TMPDIR");
+	std::string scratch = (tmp != NULL ? tmp : "/tmp");
+
+	for (int i = 1; i < argc; i += 2) {
+		if (i + 1 >= argc) {
+			printUsage(argv[0]);
+			return 1;
+		}
+		if (!strcmp(argv[i], "-t") && atoi(argv[i + 1]) > 0) {
+			threads = atoi(argv[i + 1]);
+		} else if (!strcmp(argv[i], "-c") && parseBroadPhase(argv[i + 1], method)) {
+			//Collision method, already parsed
+		} else if (!strcmp(argv[i], "-r") && atoi(argv[i + 1]) > 0) {
+			rounds = atoi(argv[i + 1]);
+		} else if (!strcmp(argv[i], "-o")) {
+			scratch = argv[i + 1];
+		} else if (parseSynthOption(argv[i], argv[i + 1], options)) {
+			haveCount = haveCount || !strcmp(argv[i], "-n");
+		} else {
+			printUsage(argv[0]);
+			return 1;
+		}
+	}
+
+	ThreadPool pool(threads);
+
+	std::vector<int> counts;
+	if (haveCount) {
+		counts.push_back(options.brushCount);
+	} else {
+		counts.push_back(1000);
+		counts.push_back(10000);
+		counts.push_back(100000);
+	}
+	for (size_t i = 0; i < counts.size(); i ++) {
+		options.brushCount = counts[i];
+		if (!runBenchmark(options, method, pool, rounds, scratch)) {
+			return 2;
+		}
+	}
+	return 0;
+}
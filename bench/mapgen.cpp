@@ -0,0 +1,71 @@
+//
+//  mapgen.cpp
+//  MBMapSplitter benchmarks
+//
+//  Copyright (c) 2015 HiGuy Smith
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+//Writes a synthetic map, for benchmarking the splitter itself or anything else that eats maps.
+//Usage: mapgen <output map> [-n brushes] [-d density] [-l uniform|clustered|corridor|grid]
+//              [-f faces] [-s seed]
+
+#include "synthmap.h"
+
+#include <fstream>
+#include <iostream>
+#include <string>
+
+static void printUsage(const char *executable) {
+	std::cout << "Usage: " << executable << " <output map> [-n brushes] [-d density] [-l uniform|clustered|corridor|grid] [-f faces] [-s seed]" << std::endl;
+}
+
+int main(int argc, const char **argv) {
+	if (argc < 2) {
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	SynthMapOptions options;
+	for (int i = 2; i < argc; i += 2) {
+		if (i + 1 >= argc) {
+			printUsage(argv[0]);
+			return 1;
+		}
+		if (!parseSynthOption(argv[i], argv[i + 1], options)) {
+			printUsage(argv[0]);
+			return 1;
+		}
+	}
+
+	std::string map;
+	generateMap(options, map);
+
+	std::ofstream output;
+	output.open(argv[1], std::ios::out | std::ios::binary);
+	if (!output.is_open()) {
+		std::cout << "Could not write " << argv[1] << std::endl;
+		return 2;
+	}
+	output.write(map.data(), map.size());
+	output.close();
+
+	std::cout << "Wrote " << options.brushCount << " brushes (" << map.size() << " bytes) to " << argv[1] << std::endl;
+	return 0;
+}
@@ -0,0 +1,238 @@
+//
+//  synthmap.cpp
+//  MBMapSplitter benchmarks
+//
+//  Copyright (c) 2015 HiGuy Smith
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#include "synthmap.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+//splitmix64. rand() gives different numbers on different systems, this doesn't.
+class SynthRandom {
+	uint64_t state;
+public:
+	SynthRandom(uint64_t seed) : state(seed) {}
+
+	uint64_t next() {
+		uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		return z ^ (z >> 31);
+	}
+
+	//[0, 1)
+	double uniform() {
+		return (next() >> 11) * (1.0 / 9007199254740992.0);
+	}
+
+	//[min, max)
+	double uniform(double min, double max) {
+		return min + (max - min) * uniform();
+	}
+
+	int below(int count) {
+		return (int)(next() % (uint64_t)count);
+	}
+
+	double normal() {
+		//Box-Muller, only one of the pair
+		double u = uniform();
+		double v = uniform();
+		return sqrt(-2.0 * log(1.0 - u)) * cos(6.283185307179586 * v);
+	}
+};
+
+//Brush sizes are picked from these, so the average size along each axis is known up front
+static const double brushSizes[] = {16, 32, 64, 128};
+static const double brushHeights[] = {16, 32, 64};
+#define BRUSH_MEAN_SIZE 60.0
+#define BRUSH_MEAN_HEIGHT (112.0 / 3.0)
+
+static void appendFace(std::string &map, const double *p) {
+	char line[256];
+	snprintf(line, sizeof(line), "( %.3f %.3f %.3f ) ( %.3f %.3f %.3f ) ( %.3f %.3f %.3f ) tex 0 0 0 1 1\n",
+	         p[0], p[1], p[2], p[3], p[4], p[5], p[6], p[7], p[8]);
+	map += line;
+}
+
+//A box the way map editors write them: one face per side, three points on each
+static void appendBrush(std::string &map, const double *lo, const double *hi, int faces, SynthRandom &random) {
+	double x = lo[0], y = lo[1], z = lo[2];
+	double x2 = hi[0], y2 = hi[1], z2 = hi[2];
+	double sides[6][9] = {
+		{x, y2, z2, x2, y2, z2, x2, y, z2},
+		{x, y, z, x2, y, z, x2, y2, z},
+		{x, y2, z2, x, y, z2, x, y, z},
+		{x2, y2, z, x2, y, z, x2, y, z2},
+		{x2, y2, z2, x, y2, z2, x, y2, z},
+		{x2, y, z, x, y, z, x, y, z2}
+	};
+
+	map += "{\n";
+	for (int i = 0; i < 6; i ++) {
+		appendFace(map, sides[i]);
+	}
+	for (int i = 6; i < faces; i ++) {
+		double points[9];
+		for (int j = 0; j < 9; j ++) {
+			points[j] = random.uniform(lo[j % 3], hi[j % 3]);
+		}
+		appendFace(map, points);
+	}
+	map += "}\n";
+}
+
+//Rounds to what the map will actually say, so sizes in the map match what we meant
+static double snap(double value) {
+	return floor(value * 1000.0 + 0.5) / 1000.0;
+}
+
+void generateMap(const SynthMapOptions &options, std::string &map) {
+	SynthRandom random(options.seed);
+	int count = (options.brushCount > 0 ? options.brushCount : 0);
+	int faces = (options.faces > 6 ? options.faces : 6);
+	double density = (options.density > 0 ? options.density : 0.01);
+
+	map.clear();
+	map.reserve((size_t)count * (faces * 72 + 6) + 64);
+	map += "{\n\"classname\" \"worldspawn\"\n\"detail_number\" \"0\"\n";
+
+	if (options.layout == LayoutGrid) {
+		//Cells are filled at random until we have enough, so density is how many of the 26
+		//neighbors are there on average
+		double fill = density / 26.0;
+		if (fill > 1) {
+			fill = 1;
+		}
+		int side = (int)ceil(cbrt(count / fill / 4.0)) + 1;
+		int across = side * 4;
+		for (int64_t cell = 0, placed = 0; placed < count; cell ++) {
+			if (random.uniform() >= fill && fill < 1) {
+				continue;
+			}
+			int64_t x = cell % across;
+			int64_t y = (cell / across) % across;
+			int64_t z = cell / ((int64_t)across * across);
+			double lo[3] = {x * 64.0, y * 64.0, z * 64.0};
+			double hi[3] = {lo[0] + 64, lo[1] + 64, lo[2] + 64};
+			appendBrush(map, lo, hi, faces, random);
+			placed ++;
+		}
+		map += "}\n";
+		return;
+	}
+
+	//Two boxes touch on an axis if their starts are closer than their sizes added up, so the level
+	//needs count * (2 * mean size)^3 / density of volume
+	double volume = count * pow(2.0 * BRUSH_MEAN_SIZE, 2) * (2.0 * BRUSH_MEAN_HEIGHT) / density;
+	double extent[3];
+	if (options.layout == LayoutCorridor) {
+		extent[1] = 4 * BRUSH_MEAN_SIZE;
+		extent[2] = 4 * BRUSH_MEAN_HEIGHT;
+		extent[0] = volume / (extent[1] * extent[2]);
+	} else {
+		//Four times wider than it is tall, in units of brush size
+		double unit = cbrt(volume / (16.0 * BRUSH_MEAN_SIZE * BRUSH_MEAN_SIZE * BRUSH_MEAN_HEIGHT));
+		extent[0] = 4 * unit * BRUSH_MEAN_SIZE;
+		extent[1] = 4 * unit * BRUSH_MEAN_SIZE;
+		extent[2] = unit * BRUSH_MEAN_HEIGHT;
+	}
+
+	//Rooms of about 200 brushes each, taking up an eighth of the level between them
+	int rooms = count / 200 + 1;
+	double roomSpread[3];
+	for (int axis = 0; axis < 3; axis ++) {
+		roomSpread[axis] = extent[axis] / (2.0 * cbrt((double)rooms)) / 2.0;
+	}
+	double roomCenter[3] = {0, 0, 0};
+
+	for (int i = 0; i < count; i ++) {
+		double lo[3], hi[3];
+		double size[3] = {
+			brushSizes[random.below(4)],
+			brushSizes[random.below(4)],
+			brushHeights[random.below(3)]
+		};
+
+		if (options.layout == LayoutClustered) {
+			//Each room's brushes come in one run, the way they would from an editor
+			if (i % 200 == 0) {
+				for (int axis = 0; axis < 3; axis ++) {
+					roomCenter[axis] = random.uniform(0, extent[axis]);
+				}
+			}
+			for (int axis = 0; axis < 3; axis ++) {
+				lo[axis] = roomCenter[axis] + random.normal() * roomSpread[axis];
+			}
+		} else {
+			for (int axis = 0; axis < 3; axis ++) {
+				lo[axis] = random.uniform(0, extent[axis]);
+			}
+		}
+
+		for (int axis = 0; axis < 3; axis ++) {
+			lo[axis] = snap(lo[axis] - extent[axis] / 2);
+			hi[axis] = lo[axis] + size[axis];
+		}
+		appendBrush(map, lo, hi, faces, random);
+	}
+	map += "}\n";
+}
+
+bool parseSynthOption(const char *name, const char *value, SynthMapOptions &options) {
+	if (!strcmp(name, "-n") && atoi(value) > 0) {
+		options.brushCount = atoi(value);
+	} else if (!strcmp(name, "-d") && atof(value) > 0) {
+		options.density = atof(value);
+	} else if (!strcmp(name, "-l") && parseLayout(value, options.layout)) {
+		//Layout, already parsed
+	} else if (!strcmp(name, "-f") && atoi(value) >= 6) {
+		options.faces = atoi(value);
+	} else if (!strcmp(name, "-s")) {
+		options.seed = strtoull(value, NULL, 10);
+	} else {
+		return false;
+	}
+	return true;
+}
+
+bool parseLayout(const char *name, MapLayout &layout) {
+	for (int i = LayoutUniform; i <= LayoutGrid; i ++) {
+		if (!strcmp(name, getLayoutName((MapLayout)i))) {
+			layout = (MapLayout)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+const char *getLayoutName(MapLayout layout) {
+	switch (layout) {
+		case LayoutClustered: return "clustered";
+		case LayoutCorridor:  return "corridor";
+		case LayoutGrid:      return "grid";
+		default:              return "uniform";
+	}
+}
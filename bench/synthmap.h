@@ -0,0 +1,63 @@
+//
+//  synthmap.h
+//  MBMapSplitter benchmarks
+//
+//  Copyright (c) 2015 HiGuy Smith
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#ifndef __MBMapSplitter__synthmap__
+#define __MBMapSplitter__synthmap__
+
+#include <stdint.h>
+#include <string>
+
+//Synthetic .map files for benchmarking. The same options always give the same map, byte for
+//byte, on any machine.
+
+enum MapLayout {
+	LayoutUniform,   //Spread evenly over a level four times wider than it is tall
+	LayoutClustered, //Bunched up into rooms, with empty space between them
+	LayoutCorridor,  //Strung out along one long, narrow corridor
+	LayoutGrid       //Equal cubes on a lattice, neighbors exactly touching
+};
+
+struct SynthMapOptions {
+	int brushCount;
+	//About how many other brushes each brush touches. Uniform and corridor maps hit this on
+	//average, clustered maps are denser inside their rooms, and grid maps top out at 26.
+	double density;
+	MapLayout layout;
+	//Faces per brush, at least 6. Past the six sides of the box, the extra faces are bevels that
+	//don't change the bounds, they're just more text to parse.
+	int faces;
+	uint64_t seed;
+
+	SynthMapOptions() : brushCount(10000), density(4.0), layout(LayoutUniform), faces(6), seed(1) {}
+};
+
+void generateMap(const SynthMapOptions &options, std::string &map);
+
+//Takes one of the generator's command line options (-n, -d, -l, -f or -s) and its value
+bool parseSynthOption(const char *name, const char *value, SynthMapOptions &options);
+
+bool parseLayout(const char *name, MapLayout &layout);
+const char *getLayoutName(MapLayout layout);
+
+#endif